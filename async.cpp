@@ -0,0 +1,376 @@
+#include "async.h"
+#include <time.h>
+
+namespace dbixx {
+
+struct future::data {
+	data() : refs(1), completed(false), failed(false) {}
+	mutex lock;
+	condition cond;
+	unsigned refs;
+	bool completed;
+	bool failed;
+	std::string error;
+	std::string query;
+
+	void add_ref()
+	{
+		mutex::guard g(lock);
+		refs++;
+	}
+	static void release(data *d)
+	{
+		if(!d)
+			return;
+		bool last;
+		{
+			mutex::guard g(d->lock);
+			last = --d->refs == 0;
+		}
+		if(last)
+			delete d;
+	}
+	void complete(dbixx_error const *e)
+	{
+		mutex::guard g(lock);
+		if(e) {
+			failed=true;
+			error=e->what();
+			query=e->query();
+		}
+		completed=true;
+		cond.notify_all();
+	}
+};
+
+future::future() : d(NULL)
+{
+}
+
+future::future(data *p) : d(p)
+{
+}
+
+future::future(future const &other) : d(other.d)
+{
+	if(d)
+		d->add_ref();
+}
+
+future const &future::operator=(future const &other)
+{
+	if(other.d)
+		other.d->add_ref();
+	data::release(d);
+	d=other.d;
+	return *this;
+}
+
+future::~future()
+{
+	data::release(d);
+}
+
+bool future::ready()
+{
+	if(!d)
+		throw dbixx_error("Future is not attached to a task");
+	mutex::guard g(d->lock);
+	return d->completed;
+}
+
+void future::wait()
+{
+	if(!d)
+		throw dbixx_error("Future is not attached to a task");
+	mutex::guard g(d->lock);
+	while(!d->completed)
+		d->cond.wait(d->lock);
+}
+
+void future::get()
+{
+	wait();
+	if(d->failed)
+		throw dbixx_error(d->error,d->query);
+}
+
+namespace {
+	class exec_task : public task {
+	public:
+		exec_task(std::string const &q) : query(q) {}
+		virtual void run(session &sql)
+		{
+			sql<<query;
+			sql.exec();
+		}
+	private:
+		std::string query;
+	};
+}
+
+async_session::async_session(pool &p,unsigned threads) :
+	pool_(p),
+	stop_(false)
+{
+	if(threads==0)
+		threads=1;
+	threads_.reserve(threads);
+	for(unsigned i=0;i<threads;i++) {
+		pthread_t tid;
+		if(pthread_create(&tid,NULL,&async_session::thread_main,this)!=0) {
+			{
+				mutex::guard g(lock_);
+				stop_=true;
+				cond_.notify_all();
+			}
+			for(unsigned j=0;j<threads_.size();j++)
+				pthread_join(threads_[j],NULL);
+			throw dbixx_error("Failed to create worker thread");
+		}
+		threads_.push_back(tid);
+	}
+}
+
+async_session::~async_session()
+{
+	{
+		mutex::guard g(lock_);
+		stop_=true;
+		cond_.notify_all();
+	}
+	for(unsigned i=0;i<threads_.size();i++)
+		pthread_join(threads_[i],NULL);
+}
+
+void *async_session::thread_main(void *self)
+{
+	static_cast<async_session *>(self)->worker();
+	return NULL;
+}
+
+future async_session::push(task *t,bool owned)
+{
+	job j;
+	j.t=t;
+	j.owned=owned;
+	j.state=new future::data();
+	future f(j.state);
+	j.state->add_ref();
+	try {
+		mutex::guard g(lock_);
+		queue_.push_back(j);
+		cond_.notify_one();
+	}
+	catch(...) {
+		future::data::release(j.state);
+		throw;
+	}
+	return f;
+}
+
+future async_session::submit(task &t)
+{
+	return push(&t,false);
+}
+
+future async_session::exec_async(std::string const &query)
+{
+	exec_task *t=new exec_task(query);
+	try {
+		return push(t,true);
+	}
+	catch(...) {
+		delete t;
+		throw;
+	}
+}
+
+unsigned async_session::pending()
+{
+	mutex::guard g(lock_);
+	return queue_.size();
+}
+
+void async_session::worker()
+{
+	for(;;) {
+		job j;
+		{
+			mutex::guard g(lock_);
+			while(queue_.empty() && !stop_)
+				cond_.wait(lock_);
+			if(queue_.empty())
+				return;
+			j=queue_.front();
+			queue_.pop_front();
+		}
+		dbixx_error *error=NULL;
+		try {
+			pooled_session sql(pool_);
+			j.t->run(*sql);
+		}
+		catch(dbixx_error const &e) {
+			error=new dbixx_error(e);
+		}
+		catch(std::exception const &e) {
+			error=new dbixx_error(e.what());
+		}
+		catch(...) {
+			error=new dbixx_error("Unknown error in asynchronous task");
+		}
+		try {
+			j.t->done(error);
+		}
+		catch(...) {}
+		if(j.owned)
+			delete j.t;
+		j.state->complete(error);
+		future::data::release(j.state);
+		delete error;
+	}
+}
+
+group_commit::group_commit(pool &p,unsigned max_batch,double max_delay) :
+	pool_(p),
+	max_batch_(max_batch == 0 ? 1 : max_batch),
+	max_delay_(max_delay),
+	stop_(false),
+	batches_(0)
+{
+	if(pthread_create(&thread_,NULL,&group_commit::thread_main,this)!=0)
+		throw dbixx_error("Failed to create worker thread");
+}
+
+group_commit::~group_commit()
+{
+	{
+		mutex::guard g(lock_);
+		stop_=true;
+		cond_.notify_all();
+	}
+	pthread_join(thread_,NULL);
+}
+
+void *group_commit::thread_main(void *self)
+{
+	static_cast<group_commit *>(self)->worker();
+	return NULL;
+}
+
+future group_commit::submit(task &t)
+{
+	job j;
+	j.t=&t;
+	j.state=new future::data();
+	future f(j.state);
+	j.state->add_ref();
+	try {
+		mutex::guard g(lock_);
+		queue_.push_back(j);
+		cond_.notify_one();
+	}
+	catch(...) {
+		future::data::release(j.state);
+		throw;
+	}
+	return f;
+}
+
+unsigned group_commit::pending()
+{
+	mutex::guard g(lock_);
+	return queue_.size();
+}
+
+unsigned long long group_commit::batches()
+{
+	mutex::guard g(lock_);
+	return batches_;
+}
+
+void group_commit::worker()
+{
+	std::vector<job> jobs;
+	for(;;) {
+		jobs.clear();
+		{
+			mutex::guard g(lock_);
+			while(queue_.empty() && !stop_)
+				cond_.wait(lock_);
+			if(queue_.empty())
+				return;
+			if(queue_.size() < max_batch_ && !stop_ && max_delay_ > 0) {
+				// Give other producers a chance to join the batch
+				timespec deadline;
+				clock_gettime(CLOCK_REALTIME,&deadline);
+				double end=deadline.tv_sec + deadline.tv_nsec * 1e-9 + max_delay_;
+				deadline.tv_sec=time_t(end);
+				deadline.tv_nsec=long((end - deadline.tv_sec) * 1e9);
+				while(queue_.size() < max_batch_ && !stop_ && cond_.wait_until(lock_,deadline))
+					;
+			}
+			while(!queue_.empty() && jobs.size() < max_batch_) {
+				jobs.push_back(queue_.front());
+				queue_.pop_front();
+			}
+		}
+		execute(jobs);
+	}
+}
+
+void group_commit::execute(std::vector<job> &jobs)
+{
+	std::vector<dbixx_error *> errors(jobs.size(),static_cast<dbixx_error *>(NULL));
+	dbixx_error *batch_error=NULL;
+	try {
+		pooled_session sql(pool_);
+		try {
+			transaction batch(*sql);
+			for(unsigned i=0;i<jobs.size();i++) {
+				try {
+					transaction step(*sql);
+					jobs[i].t->run(*sql);
+					step.commit();
+				}
+				catch(dbixx_error const &e) {
+					errors[i]=new dbixx_error(e);
+				}
+				catch(std::exception const &e) {
+					errors[i]=new dbixx_error(e.what());
+				}
+				catch(...) {
+					errors[i]=new dbixx_error("Unknown error in group commit task");
+				}
+			}
+			batch.commit();
+		}
+		catch(...) {
+			sql.invalidate();
+			throw;
+		}
+	}
+	catch(dbixx_error const &e) {
+		batch_error=new dbixx_error(e);
+	}
+	catch(std::exception const &e) {
+		batch_error=new dbixx_error(e.what());
+	}
+	if(!batch_error) {
+		mutex::guard g(lock_);
+		batches_++;
+	}
+	for(unsigned i=0;i<jobs.size();i++) {
+		dbixx_error const *error = errors[i] ? errors[i] : batch_error;
+		try {
+			jobs[i].t->done(error);
+		}
+		catch(...) {}
+		jobs[i].state->complete(error);
+		future::data::release(jobs[i].state);
+		delete errors[i];
+	}
+	delete batch_error;
+}
+
+} // dbixx
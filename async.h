@@ -0,0 +1,196 @@
+#ifndef _DBIXX_ASYNC_H_
+#define _DBIXX_ASYNC_H_
+
+#include "dbixx.h"
+#include "pool.h"
+#include "mutex.h"
+#include <deque>
+#include <vector>
+
+namespace dbixx {
+
+///
+/// \brief Unit of work executed by async_session using one of the pooled sessions
+///
+class task {
+public:
+	virtual ~task() {}
+	///
+	/// Execute the work using session \a sql. Called in a worker thread.
+	///
+	virtual void run(session &sql) = 0;
+	///
+	/// Completion callback, called in the worker thread after run() finished. \a error is NULL
+	/// on success, otherwise it points to the error that was thrown.
+	///
+	virtual void done(dbixx_error const * /*error*/) {}
+};
+
+///
+/// \brief Handle to the completion of a task submitted to async_session.
+///
+/// Futures may be copied freely, all copies refer to the same task.
+///
+class future {
+public:
+	///
+	/// Create an empty future that is not attached to any task
+	///
+	future();
+	future(future const &other);
+	future const &operator=(future const &other);
+	~future();
+	///
+	/// Check if the future is attached to a task
+	///
+	bool valid() const { return d!=NULL; }
+	///
+	/// Check if the task was completed
+	///
+	bool ready();
+	///
+	/// Wait till the task is completed
+	///
+	void wait();
+	///
+	/// Wait till the task is completed, throws dbixx_error if the task failed
+	///
+	void get();
+private:
+	struct data;
+	data *d;
+	explicit future(data *p);
+	friend class async_session;
+	friend class group_commit;
+};
+
+///
+/// \brief Executes queries in a set of worker threads using sessions from a pool, so
+/// the calling thread is not blocked during network round trip.
+///
+/// \code
+///  struct add_user : public dbixx::task {
+///      int id; std::string name;
+///      void run(dbixx::session &sql) {
+///          sql<<"INSERT INTO users(id,name) VALUES(?,?)",id,name,dbixx::exec();
+///      }
+///  };
+///
+///  dbixx::pool connections("sqlite3:dbname=test.db;sqlite3_dbdir=./");
+///  dbixx::async_session async(connections,4);
+///  add_user t; ...
+///  dbixx::future f=async.submit(t);
+///  ... do something else ...
+///  f.get();
+/// \endcode
+///
+class async_session {
+	// non copyable
+	async_session(async_session const &);
+	async_session const &operator=(async_session const &);
+public:
+	///
+	/// Start \a threads worker threads that take their sessions from pool \a p
+	///
+	async_session(pool &p,unsigned threads=4);
+	///
+	/// Execute all pending tasks and stop the worker threads
+	///
+	~async_session();
+	///
+	/// Queue task \a t for execution. The task must remain valid till it is completed.
+	///
+	future submit(task &t);
+	///
+	/// Queue execution of the statement \a query that has no parameters, see session::exec()
+	///
+	future exec_async(std::string const &query);
+	///
+	/// Get number of tasks waiting for execution
+	///
+	unsigned pending();
+private:
+	struct job {
+		task *t;
+		bool owned;
+		future::data *state;
+	};
+
+	static void *thread_main(void *self);
+	void worker();
+	future push(task *t,bool owned);
+
+	pool &pool_;
+	std::vector<pthread_t> threads_;
+	std::deque<job> queue_;
+	bool stop_;
+	mutex lock_;
+	condition cond_;
+};
+
+///
+/// \brief Executes small write tasks submitted by many threads in shared transactions, so the
+/// cost of a commit is paid once per batch rather then once per task.
+///
+/// A background thread collects up to \a max_batch tasks, or the tasks submitted during \a max_delay
+/// seconds after the first one, and runs them in one transaction using a session from the pool.
+/// Each task runs in its own nested transaction (savepoint), so a failed task is rolled back
+/// alone and the others are still committed. The futures of the tasks become ready, and
+/// task::done() is called, only after the batch is committed.
+///
+/// \code
+///  dbixx::group_commit writer(connections,200,0.005);
+///  ... in any thread ...
+///  add_user t; ...
+///  writer.submit(t).get(); // the user is stored
+/// \endcode
+///
+class group_commit {
+	// non copyable
+	group_commit(group_commit const &);
+	group_commit const &operator=(group_commit const &);
+public:
+	///
+	/// Start the helper thread that takes its sessions from pool \a p
+	///
+	group_commit(pool &p,unsigned max_batch=100,double max_delay=0.01);
+	///
+	/// Commit all pending tasks and stop the helper thread
+	///
+	~group_commit();
+	///
+	/// Queue task \a t for execution in the next batch. The task must remain valid till it is completed.
+	///
+	future submit(task &t);
+	///
+	/// Get number of tasks waiting for execution
+	///
+	unsigned pending();
+	///
+	/// Get number of committed batches
+	///
+	unsigned long long batches();
+private:
+	struct job {
+		task *t;
+		future::data *state;
+	};
+
+	static void *thread_main(void *self);
+	void worker();
+	void execute(std::vector<job> &jobs);
+
+	pool &pool_;
+	unsigned max_batch_;
+	double max_delay_;
+	pthread_t thread_;
+	std::deque<job> queue_;
+	bool stop_;
+	unsigned long long batches_;
+	mutex lock_;
+	condition cond_;
+};
+
+} // dbixx
+
+#endif // _DBIXX_ASYNC_H_
@@ -0,0 +1,240 @@
+#include "dbixx.h"
+#include "util.h"
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <limits>
+
+using namespace dbixx;
+using namespace std;
+
+//
+// Output is tab separated: name, operations, total seconds, ns per operation, operations per second
+//
+static void report(char const *name,unsigned long long ops,double seconds)
+{
+	if(ops==0)
+		ops=1;
+	cout << name << '\t' << ops << '\t'
+		<< std::fixed << std::setprecision(6) << seconds << '\t'
+		<< std::setprecision(1) << seconds * 1e9 / ops << '\t'
+		<< std::setprecision(0) << ops / seconds << endl;
+}
+
+//
+// The stream based formatting used by dbixx before, kept as a baseline
+//
+template<typename T>
+static void stream_format(std::string &out,T v)
+{
+	std::ostringstream ss;
+	ss.imbue(std::locale::classic());
+	if(!std::numeric_limits<T>::is_integer) {
+		ss<<std::setprecision(std::numeric_limits<T>::digits10+1);
+	}
+	ss << v;
+	out+=ss.str();
+}
+
+static void stream_format(std::string &out,std::tm const &v)
+{
+	std::ostringstream ss;
+	ss.imbue(std::locale::classic());
+	ss<<std::setfill('0');
+	ss <<"'";
+	ss << std::setw(4) << v.tm_year+1900 <<'-';
+	ss << std::setw(2) << v.tm_mon+1 <<'-';
+	ss << std::setw(2) << v.tm_mday <<' ';
+	ss << std::setw(2) << v.tm_hour <<':';
+	ss << std::setw(2) << v.tm_min  <<':';
+	ss << std::setw(2) << v.tm_sec;
+	ss <<"'";
+	out+=ss.str();
+}
+
+template<typename T>
+static void bench_bind(char const *name,T const &v,unsigned long long n)
+{
+	std::string baseline;
+	std::string query="INSERT INTO t VALUES(";
+	double start=now();
+	for(unsigned long long i=0;i<n;i++) {
+		baseline=query;
+		stream_format(baseline,v);
+		baseline+=")";
+	}
+	std::string bname=std::string("stream_") + name;
+	report(bname.c_str(),n,now()-start);
+
+	// Numeric values do not require open connection
+	session sql;
+	start=now();
+	for(unsigned long long i=0;i<n;i++) {
+		sql.query("INSERT INTO t VALUES(?)");
+		sql.bind(v);
+	}
+	std::string dname=std::string("bind_") + name;
+	report(dname.c_str(),n,now()-start);
+}
+
+static void bench_splice(session &sql,unsigned long long n,std::tm const &t)
+{
+	double start=now();
+	for(unsigned long long i=0;i<n;i++) {
+		sql<<"SELECT id FROM bench WHERE i=? AND d=? AND s=? AND t=?",int(i),i*0.5,"text value",t;
+	}
+	report("query_splice",n,now()-start);
+
+	statement st(sql,"SELECT id FROM bench WHERE i=? AND d=? AND s=? AND t=?");
+	start=now();
+	for(unsigned long long i=0;i<n;i++) {
+		st.reset();
+		st,int(i),i*0.5,"text value",t;
+	}
+	report("statement_splice",n,now()-start);
+}
+
+static void bench_insert(session &sql,unsigned long long n,std::tm const &t)
+{
+	sql<<"DELETE FROM bench",exec();
+	unsigned long long single=n/100 + 1;
+	double start=now();
+	for(unsigned long long i=0;i<single;i++) {
+		sql<<"INSERT INTO bench(i,d,s,t) VALUES(?,?,?,?)",int(i),i*0.5,"text value",t,exec();
+	}
+	report("exec_insert_autocommit",single,now()-start);
+
+	sql<<"DELETE FROM bench",exec();
+	start=now();
+	{
+		transaction tr(sql);
+		for(unsigned long long i=0;i<n;i++) {
+			sql<<"INSERT INTO bench(i,d,s,t) VALUES(?,?,?,?)",int(i),i*0.5,"text value",t,exec();
+		}
+		tr.commit();
+	}
+	report("exec_insert_transaction",n,now()-start);
+
+	sql<<"DELETE FROM bench",exec();
+	start=now();
+	{
+		transaction tr(sql);
+		bulk_insert ins(sql,"INSERT INTO bench(i,d,s,t) VALUES","(?,?,?,?)");
+		for(unsigned long long i=0;i<n;i++) {
+			ins,int(i),i*0.5,"text value",t;
+		}
+		ins.flush();
+		tr.commit();
+	}
+	report("bulk_insert_transaction",n,now()-start);
+}
+
+template<typename T>
+static void bench_decode(session &sql,char const *name,char const *column)
+{
+	result res;
+	sql<<std::string("SELECT ") + column + " FROM bench",res;
+	row r;
+	T v=T();
+	unsigned long long n=0;
+	double start=now();
+	while(res.next(r)) {
+		r>>v;
+		n++;
+	}
+	report(name,n,now()-start);
+}
+
+static void bench_decode_row(session &sql)
+{
+	result res;
+	row r;
+	long long i=0;
+	double d=0;
+	std::string s;
+	unsigned long long n=0;
+	sql<<"SELECT i,d,s FROM bench",res;
+	double start=now();
+	while(res.next(r)) {
+		r>>i>>d>>s;
+		n++;
+	}
+	report("decode_row_operator",n,now()-start);
+
+	n=0;
+	sql<<"SELECT i,d,s FROM bench",res;
+	res.into(i).into(d).into(s);
+	start=now();
+	while(res.next()) {
+		n++;
+	}
+	report("decode_row_into",n,now()-start);
+}
+
+static void bench_single(session &sql,unsigned long long n,unsigned long long rows)
+{
+	row r;
+	int v;
+	double start=now();
+	for(unsigned long long i=0;i<n;i++) {
+		sql<<"SELECT i FROM bench WHERE id=?",(i % rows) + 1;
+		if(sql.single(r))
+			r>>v;
+	}
+	report("single_lookup",n,now()-start);
+
+	statement st(sql,"SELECT i FROM bench WHERE id=?");
+	start=now();
+	for(unsigned long long i=0;i<n;i++) {
+		st.reset();
+		st,(i % rows) + 1;
+		if(st.single(r))
+			r>>v;
+	}
+	report("single_lookup_statement",n,now()-start);
+}
+
+int main(int argc,char **argv)
+{
+	unsigned long long n = argc > 1 ? atoll(argv[1]) : 1000000;
+	std::string conn_str = argc > 2 ? argv[2] : "sqlite3:dbname=bench.db;sqlite3_dbdir=./";
+	cout << "name\toperations\tseconds\tns_per_op\tops_per_sec" << endl;
+	try {
+		std::tm t=std::tm();
+		t.tm_year=110;
+		t.tm_mon=5;
+		t.tm_mday=17;
+		t.tm_hour=12;
+		t.tm_min=30;
+		t.tm_sec=59;
+		bench_bind("int",-123456,n);
+		bench_bind("long_long",1234567890123LL,n);
+		bench_bind("double",1234.5678,n);
+		bench_bind("double_integral",1048576.0,n);
+		bench_bind("double_full_precision",3.1415926535897931,n);
+		bench_bind("long_double",2.718281828459045L,n);
+		bench_bind("datetime",t,n);
+
+		session sql(conn_str);
+		sql<<"DROP TABLE IF EXISTS bench",exec();
+		sql<<"CREATE TABLE bench ( "
+			" id integer primary key autoincrement not null, "
+			" i integer, d real, s text, t timestamp )",exec();
+		unsigned long long rows = n / 10 + 1;
+		bench_splice(sql,n,t);
+		bench_insert(sql,rows,t);
+		bench_decode<int>(sql,"decode_int","i");
+		bench_decode<long long>(sql,"decode_long_long","i");
+		bench_decode<double>(sql,"decode_double","d");
+		bench_decode<std::string>(sql,"decode_string","s");
+		bench_decode<std::tm>(sql,"decode_datetime","t");
+		bench_decode_row(sql);
+		bench_single(sql,rows,rows);
+		sql<<"DROP TABLE bench",exec();
+	}
+	catch(std::exception const &e) {
+		cerr << "Error:" << e.what() << endl;
+		return 1;
+	}
+	return 0;
+}
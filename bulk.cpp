@@ -0,0 +1,67 @@
+#include "dbixx.h"
+
+namespace dbixx {
+
+bulk_insert::bulk_insert(session &s,std::string const &p,std::string const &r,unsigned rows,size_t bytes) :
+	sql(s),
+	prefix(p),
+	row_template(r),
+	batch_key(p+' '+r+",..."),
+	max_rows(rows),
+	max_bytes(bytes),
+	pending_rows(0),
+	row_open(false),
+	affected_rows(0)
+{
+	if(max_rows==0)
+		max_rows=1;
+}
+
+void bulk_insert::begin_row()
+{
+	if(row_open)
+		return;
+	// The row is spliced into the text of the batch, so it can't be a server side prepared statement
+	bool prepare=sql.use_server_prepare;
+	sql.use_server_prepare=false;
+	try {
+		sql.query(row_template);
+	}
+	catch(...) {
+		sql.use_server_prepare=prepare;
+		throw;
+	}
+	sql.use_server_prepare=prepare;
+	row_open=true;
+}
+
+void bulk_insert::end_row()
+{
+	if(!sql.state.complete)
+		return;
+	row_open=false;
+	if(pending_rows==0) {
+		batch=prefix;
+		batch+=' ';
+	}
+	else {
+		batch+=',';
+	}
+	batch+=sql.state.escaped_query;
+	pending_rows++;
+	if(pending_rows >= max_rows || batch.size() >= max_bytes)
+		flush();
+}
+
+void bulk_insert::flush()
+{
+	if(row_open)
+		throw dbixx_error("Not all parameters are bind");
+	if(pending_rows==0)
+		return;
+	pending_rows=0;
+	sql.exec_text(batch,batch_key);
+	affected_rows+=sql.affected();
+}
+
+} // dbixx
@@ -0,0 +1,350 @@
+#include "cache.h"
+#include <algorithm>
+#include <ctype.h>
+#include <string.h>
+
+namespace dbixx {
+
+namespace {
+	//
+	// Splits SQL text to lower case words and single punctuation characters,
+	// string literals and comments are skipped and qualified names are reduced to
+	// their last component, so "public"."Users" becomes users
+	//
+	class tokenizer {
+	public:
+		tokenizer(std::string const &s) : q(s), pos(0) {}
+		bool next(std::string &tok)
+		{
+			while(pos < q.size()) {
+				char c=q[pos];
+				if(c=='\'') {
+					pos=q.find('\'',pos+1);
+					pos = pos==std::string::npos ? q.size() : pos+1;
+				}
+				else if(c=='-' && pos+1 < q.size() && q[pos+1]=='-') {
+					pos=q.find('\n',pos);
+				}
+				else if(isspace(static_cast<unsigned char>(c))) {
+					pos++;
+				}
+				else if(is_name(c)) {
+					tok.clear();
+					for(;pos < q.size() && is_name(q[pos]);pos++) {
+						char ch=q[pos];
+						if(ch=='.')
+							tok.clear();
+						else if(ch!='"' && ch!='`' && ch!='[' && ch!=']')
+							tok+=char(tolower(static_cast<unsigned char>(ch)));
+					}
+					if(!tok.empty())
+						return true;
+				}
+				else {
+					tok.assign(1,c);
+					pos++;
+					return true;
+				}
+			}
+			return false;
+		}
+		static bool is_name(char c)
+		{
+			return isalnum(static_cast<unsigned char>(c)) || strchr("_$.\"`[]",c)!=NULL;
+		}
+	private:
+		std::string const &q;
+		size_t pos;
+	};
+
+	bool one_of(std::string const &w,char const * const *words)
+	{
+		for(;*words;words++)
+			if(w==*words)
+				return true;
+		return false;
+	}
+
+	// Words that end the list of tables after FROM
+	char const * const end_of_tables[] = {
+		"where", "on", "using", "group", "order", "limit", "having", "union", "inner", "left",
+		"right", "full", "cross", "natural", "outer", "window", "offset", "for", "except",
+		"intersect", "select", "into", "values", "set", "returning", NULL
+	};
+	// Words between the statement keyword and the modified table name
+	char const * const write_modifiers[] = {
+		"only", "table", "or", "ignore", "replace", "rollback", "abort", "fail",
+		"low_priority", "quick", "delayed", "high_priority", NULL
+	};
+	// Statements that do not modify any data
+	char const * const read_only[] = {
+		"select", "begin", "commit", "rollback", "end", "start", "savepoint", "release",
+		"set", "show", "explain", "declare", "fetch", "close", "move", "prepare", "deallocate",
+		"lock", "listen", "unlisten", "notify", "analyze", "vacuum", "pragma", "use",
+		"checkpoint", "discard", "reset", NULL
+	};
+}
+
+query_cache::query_cache(size_t max_bytes,int ttl) :
+	max_bytes_(max_bytes),
+	bytes_(0),
+	ttl_(ttl),
+	generation_(0),
+	cleared_(0),
+	hits_(0),
+	misses_(0),
+	evictions_(0)
+{
+}
+
+void query_cache::ttl(int seconds)
+{
+	mutex::guard g(lock_);
+	ttl_=seconds;
+}
+
+size_t query_cache::size()
+{
+	mutex::guard g(lock_);
+	return index.size();
+}
+
+size_t query_cache::bytes()
+{
+	mutex::guard g(lock_);
+	return bytes_;
+}
+
+unsigned long long query_cache::hits()
+{
+	mutex::guard g(lock_);
+	return hits_;
+}
+
+unsigned long long query_cache::misses()
+{
+	mutex::guard g(lock_);
+	return misses_;
+}
+
+unsigned long long query_cache::evictions()
+{
+	mutex::guard g(lock_);
+	return evictions_;
+}
+
+unsigned long long query_cache::generation()
+{
+	mutex::guard g(lock_);
+	return generation_;
+}
+
+void query_cache::remove(entries_type::iterator p,entries_type &removed)
+{
+	index.erase(p->key);
+	for(unsigned i=0;i<p->tags.size();i++) {
+		std::pair<tags_type::iterator,tags_type::iterator> range=tagged.equal_range(p->tags[i]);
+		while(range.first!=range.second) {
+			if(range.first->second==p)
+				tagged.erase(range.first++);
+			else
+				++range.first;
+		}
+	}
+	bytes_-=p->bytes;
+	release(*p);
+	// Destroy the data later, outside of the lock
+	removed.splice(removed.end(),entries,p);
+}
+
+void query_cache::release(entry &e)
+{
+	// Readers still copying the data become responsible for deleting it
+	if(--e.data->refs!=0)
+		e.data=0;
+}
+
+bool query_cache::get(std::string const &key,table &t)
+{
+	shared_table *data;
+	{
+		entries_type removed;
+		mutex::guard g(lock_);
+		index_type::iterator p=index.find(key);
+		if(p==index.end()) {
+			misses_++;
+			return false;
+		}
+		entries_type::iterator e=p->second;
+		if(e->expires <= time(NULL)) {
+			remove(e,removed);
+			misses_++;
+			return false;
+		}
+		entries.splice(entries.begin(),entries,e);
+		hits_++;
+		data=e->data;
+		data->refs++;
+	}
+	// The data is never modified once stored, copy it without blocking other sessions
+	try {
+		t=data->data;
+	}
+	catch(...) {
+		unref(data);
+		throw;
+	}
+	unref(data);
+	return true;
+}
+
+void query_cache::unref(shared_table *data)
+{
+	bool last;
+	{
+		mutex::guard g(lock_);
+		last = --data->refs==0;
+	}
+	if(last)
+		delete data;
+}
+
+void query_cache::put(std::string const &key,table const &t,std::vector<std::string> const &tags,int ttl)
+{
+	store(key,t,tags,ttl,generation());
+}
+
+void query_cache::store(std::string const &key,table const &t,std::vector<std::string> const &tags,
+			int ttl,unsigned long long gen)
+{
+	// Prepare the entry before taking the lock
+	entries_type tmp(1);
+	entry &e=tmp.front();
+	e.key=key;
+	e.data=new shared_table();
+	e.data->data=t;
+	e.tags=tags;
+	e.bytes=sizeof(entry) + 2*key.size() + t.memory_size();
+	for(unsigned i=0;i<tags.size();i++)
+		e.bytes+=tags[i].size()*2;
+
+	entries_type removed;
+	mutex::guard g(lock_);
+	// The data may be modified while the query was executed, only the modifications
+	// of the tables the query reads matter
+	if(gen < cleared_ || e.bytes > max_bytes_)
+		return;
+	for(unsigned i=0;i<tags.size();i++) {
+		std::map<std::string,unsigned long long>::const_iterator p=invalidated_.find(tags[i]);
+		if(p!=invalidated_.end() && gen < p->second)
+			return;
+	}
+	e.expires=time(NULL) + (ttl < 0 ? ttl_ : ttl);
+	index_type::iterator p=index.find(key);
+	if(p!=index.end())
+		remove(p->second,removed);
+	entries.splice(entries.begin(),tmp);
+	index[key]=entries.begin();
+	for(unsigned i=0;i<tags.size();i++)
+		tagged.insert(std::make_pair(tags[i],entries.begin()));
+	bytes_+=e.bytes;
+	while(bytes_ > max_bytes_) {
+		remove(--entries.end(),removed);
+		evictions_++;
+	}
+}
+
+void query_cache::invalidate(std::string const &tag)
+{
+	entries_type removed;
+	mutex::guard g(lock_);
+	invalidated_[tag]=++generation_;
+	std::vector<entries_type::iterator> matched;
+	std::pair<tags_type::iterator,tags_type::iterator> range=tagged.equal_range(tag);
+	for(;range.first!=range.second;++range.first)
+		matched.push_back(range.first->second);
+	for(unsigned i=0;i<matched.size();i++)
+		remove(matched[i],removed);
+}
+
+void query_cache::clear()
+{
+	entries_type removed;
+	mutex::guard g(lock_);
+	cleared_=++generation_;
+	// Tag stamps older than the clear are not needed anymore
+	invalidated_.clear();
+	index.clear();
+	tagged.clear();
+	bytes_=0;
+	for(entries_type::iterator p=entries.begin();p!=entries.end();++p)
+		release(*p);
+	removed.swap(entries);
+}
+
+void query_cache::read_tags(std::string const &q,std::vector<std::string> &tags)
+{
+	tokenizer t(q);
+	std::string tok;
+	enum { other, expect_table, after_table } state=other;
+	while(t.next(tok)) {
+		if(tok=="from" || tok=="join") {
+			state=expect_table;
+			continue;
+		}
+		bool word=tokenizer::is_name(tok[0]);
+		switch(state) {
+		case expect_table:
+			if(tok=="only" || tok=="lateral")
+				break;
+			if(word) {
+				if(std::find(tags.begin(),tags.end(),tok)==tags.end())
+					tags.push_back(tok);
+				state=after_table;
+			}
+			else
+				state=other;
+			break;
+		case after_table:
+			// Either an alias or the next table after comma
+			if(tok==",")
+				state=expect_table;
+			else if(!word || one_of(tok,end_of_tables))
+				state=other;
+			break;
+		case other:
+			break;
+		}
+	}
+}
+
+query_cache::write_kind query_cache::written_table(std::string const &q,std::string &tag)
+{
+	tokenizer t(q);
+	std::string tok;
+	if(!t.next(tok))
+		return no_write;
+	char const *skip_to=NULL;
+	if(tok=="insert" || tok=="replace")
+		skip_to="into";
+	else if(tok=="delete")
+		skip_to="from";
+	else if(tok!="update" && tok!="truncate")
+		return one_of(tok,read_only) ? no_write : schema_write;
+	if(skip_to) {
+		while(t.next(tok) && tok!=skip_to)
+			;
+	}
+	while(t.next(tok)) {
+		if(one_of(tok,write_modifiers))
+			continue;
+		if(tokenizer::is_name(tok[0])) {
+			tag=tok;
+			return table_write;
+		}
+		break;
+	}
+	return schema_write;
+}
+
+} // dbixx
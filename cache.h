@@ -0,0 +1,141 @@
+#ifndef _DBIXX_CACHE_H_
+#define _DBIXX_CACHE_H_
+
+#include "dbixx.h"
+#include "table.h"
+#include "mutex.h"
+#include <list>
+#include <map>
+#include <vector>
+#include <string>
+
+namespace dbixx {
+
+///
+/// \brief Thread safe cache of query results that may be shared by several sessions, see session::cache()
+///
+/// Results are stored as tables under the final text of the query with all parameters
+/// bound. Each entry expires after its time to live and the least recently used entries
+/// are removed once the total size of the cache exceeds its limit.
+///
+/// Entries are tagged by the names of the tables that follow FROM and JOIN in the query.
+/// INSERT, UPDATE, DELETE, REPLACE and TRUNCATE statements executed with session::exec()
+/// invalidate all entries tagged by the modified table, other data definition statements
+/// like CREATE, ALTER or DROP invalidate the entire cache. Modifications made by other
+/// means are seen only after the entries expire or invalidate() is called.
+///
+/// \code
+///  dbixx::query_cache cache(64*1024*1024,30);
+///  sql.cache(&cache);
+///  dbixx::table t;
+///  sql<<"SELECT value FROM config WHERE name=?",name,t;
+/// \endcode
+///
+class query_cache {
+	// non copyable
+	query_cache(query_cache const &);
+	query_cache const &operator=(query_cache const &);
+public:
+	///
+	/// Create cache limited to \a max_bytes bytes where entries expire after \a ttl seconds
+	///
+	query_cache(size_t max_bytes=16*1024*1024,int ttl=60);
+	///
+	/// Set default time to live of new entries in seconds
+	///
+	void ttl(int seconds);
+	///
+	/// Get a copy of the result cached under \a key into \a t, returns false if there is no
+	/// valid entry for it. The cached result is shared, the lock is not held while it is copied.
+	///
+	bool get(std::string const &key,table &t);
+	///
+	/// Store the result \a t under \a key tagged by \a tags. If \a ttl is negative
+	/// the default time to live is used.
+	///
+	void put(std::string const &key,table const &t,std::vector<std::string> const &tags,int ttl=-1);
+	///
+	/// Remove all entries tagged by \a tag
+	///
+	void invalidate(std::string const &tag);
+	///
+	/// Remove all entries
+	///
+	void clear();
+	///
+	/// Get number of entries
+	///
+	size_t size();
+	///
+	/// Get approximate memory used by the entries in bytes
+	///
+	size_t bytes();
+	///
+	/// Get number of lookups that found a valid entry
+	///
+	unsigned long long hits();
+	///
+	/// Get number of lookups that did not find a valid entry
+	///
+	unsigned long long misses();
+	///
+	/// Get number of entries removed because of the size limit
+	///
+	unsigned long long evictions();
+private:
+	//
+	// Immutable result shared by the entry and the readers copying it
+	//
+	struct shared_table {
+		shared_table() : refs(1) {}
+		table data;
+		unsigned refs; // guarded by lock_
+	};
+	//
+	// The entry deletes its data unless the ownership was passed to a reader
+	//
+	struct entry {
+		entry() : data(0) {}
+		~entry() { delete data; }
+		std::string key;
+		shared_table *data;
+		std::vector<std::string> tags;
+		time_t expires;
+		size_t bytes;
+	};
+	typedef std::list<entry> entries_type;
+	typedef std::map<std::string,entries_type::iterator> index_type;
+	typedef std::multimap<std::string,entries_type::iterator> tags_type;
+
+	enum write_kind { no_write, table_write, schema_write };
+
+	unsigned long long generation();
+	void store(std::string const &key,table const &t,std::vector<std::string> const &tags,int ttl,unsigned long long gen);
+	void remove(entries_type::iterator p,entries_type &removed);
+	void release(entry &e);
+	void unref(shared_table *data);
+	static void read_tags(std::string const &q,std::vector<std::string> &tags);
+	static write_kind written_table(std::string const &q,std::string &tag);
+
+	entries_type entries;
+	index_type index;
+	tags_type tagged;
+	size_t max_bytes_;
+	size_t bytes_;
+	int ttl_;
+	// Counter of modifications, the values of the last clear() and of the last
+	// invalidation of each tag
+	unsigned long long generation_;
+	unsigned long long cleared_;
+	std::map<std::string,unsigned long long> invalidated_;
+	unsigned long long hits_;
+	unsigned long long misses_;
+	unsigned long long evictions_;
+	mutex lock_;
+
+	friend class session;
+};
+
+} // dbixx
+
+#endif // _DBIXX_CACHE_H_
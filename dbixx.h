@@ -5,10 +5,49 @@
 #include <stdexcept>
 #include <ctime>
 #include <map>
+#include <list>
+#include <vector>
 #include <cstring>
 
 namespace dbixx {
 
+class session;
+class batch;
+class pipeline;
+class async_session;
+class table;
+class query_cache;
+class replica_set;
+class statement;
+
+///
+/// \brief Mapping of a user structure to the columns of a query, see DBIXX_MAP_BEGIN
+///
+template<typename T>
+struct mapping;
+
+///
+/// \brief Wrapper used for binding all mapped fields of a structure, see fields()
+///
+template<typename T>
+struct mapped {
+	mapped(T const &o) : object(o) {}
+	T const &object;
+};
+
+///
+/// Bind all the fields of structure \a o that has a mapping in their order, for example:
+///
+/// \code
+///  sql<<"INSERT INTO users(id,name,created) VALUES(?,?,?)",dbixx::fields(u),dbixx::exec();
+/// \endcode
+///
+template<typename T>
+mapped<T> fields(T const &o)
+{
+	return mapped<T>(o);
+}
+
 ///
 /// \brief Exception throw in case of error using database
 ///
@@ -34,6 +73,61 @@ private:
 	std::string query_;
 };
 
+///
+/// \brief Description of the columns of a query result.
+///
+/// It is loaded once per result, so the rows do not query the column types from
+/// the driver for every fetched value.
+///
+class schema {
+public:
+	///
+	/// Get number of columns
+	///
+	unsigned size() const { return columns.size(); }
+	///
+	/// Get libdbi type (DBI_TYPE_*) of the column at position \a pos (starting from 1)
+	///
+	unsigned short type(int pos) const { return get(pos).type; }
+	///
+	/// Get libdbi attributes of the column at position \a pos (starting from 1)
+	///
+	unsigned attribs(int pos) const { return get(pos).attribs; }
+	///
+	/// Get the name of the column at position \a pos (starting from 1)
+	///
+	std::string const &name(int pos) const { return get(pos).name; }
+	///
+	/// Get the position (starting from 1) of the column named \a name, returns 0 if
+	/// there is no such column
+	///
+	int find(std::string const &name) const
+	{
+		std::map<std::string,int>::const_iterator p=by_name.find(name);
+		return p==by_name.end() ? 0 : p->second;
+	}
+private:
+	struct column {
+		std::string name;
+		unsigned short type;
+		unsigned attribs;
+	};
+	column const &get(int pos) const
+	{
+		if(pos < 1 || unsigned(pos) > columns.size())
+			throw dbixx_error("Invalid field");
+		return columns[pos-1];
+	}
+	void load(dbi_result r);
+	void clear();
+
+	std::vector<column> columns;
+	std::map<std::string,int> by_name;
+
+	friend class row;
+	friend class result;
+};
+
 ///
 /// \brief This class represents a single row that is fetched from the DB
 ///
@@ -47,7 +141,7 @@ public:
 	/// 
 	/// Creates an empty row
 	/// 
-	row() { current=0; owner=false; res=NULL; }
+	row() { current=0; owner=false; res=NULL; info=NULL; source=NULL; }
 	~row();
 	///
 	/// Get underlying libdbi object. For low level access
@@ -66,6 +160,15 @@ public:
 	///
 	bool isnull(std::string const &id);
 	///
+	/// Get the position (starting from 1) of the column named \a name, throws dbixx_error
+	/// if there is no such column
+	///
+	int index(std::string const &name);
+	///
+	/// Get the description of the columns of this row
+	///
+	schema const &columns();
+	///
 	/// Fetch \a value at position \a pos (starting from 1), returns false if the column has null value.
 	///
 	bool fetch(int pos,short &value);
@@ -118,6 +221,28 @@ public:
 	///
 	bool fetch(int pos,std::tm &value);
 	///
+	/// Fetch a pointer to the text at position \a pos (starting from 1) into \a value and its size into
+	/// \a length without copying it, returns false if the column has null value.
+	///
+	/// The text is owned by the driver and remains valid as long as the row points to the same
+	/// record, i.e. till next call of result::next() or destruction of the result.
+	///
+	bool fetch_view(int pos,char const *&value,size_t &length);
+	///
+	/// Fetch a pointer to the binary data at position \a pos (starting from 1) into \a value and its
+	/// size into \a length without copying it, returns false if the column has null value. String
+	/// columns are returned as their bytes without the terminating NUL.
+	///
+	/// The data is owned by the driver and remains valid as long as the row points to the same
+	/// record, i.e. till next call of result::next() or destruction of the result.
+	///
+	bool fetch_binary(int pos,unsigned char const *&value,size_t &length);
+	///
+	/// Fetch \a value from the column named \a name, returns false if the column has null value.
+	///
+	template<typename T>
+	bool fetch(std::string const &name,T &value) { return fetch(index(name),value); }
+	///
 	/// Syntactic sugar for isnull(id)
 	///
 	bool operator[](std::string const & id) { return isnull(id); }
@@ -158,17 +283,95 @@ private:
 	dbi_result res;
 	bool owner;
 	int current;
+	// NULL for a row owning its result until the columns are needed by name
+	schema const *info;
+	schema own_info;
+	session *source;
 	void check_set();
+	schema const &get_info();
+	unsigned short type(int pos) { return info ? info->type(pos) : dbi_result_get_field_type_idx(res,pos); }
+	unsigned attribs(int pos) { return info ? info->attribs(pos) : dbi_result_get_field_attribs_idx(res,pos); }
 
-	void set(dbi_result &r);
+	void set(dbi_result &r,schema const *s);
 	void reset();
-	void assign(dbi_result &r);
+	void assign(dbi_result &r,session *s);
 	bool next();
+	static void release(dbi_result r,session *s);
 
 	friend class session;
 	friend class result;
 };
 
+///
+/// \brief Direct conversion of a column value to C++ type used when the column type matches
+/// exactly, other combinations use row::fetch()
+///
+template<typename T>
+struct fetch_traits {
+	static bool direct(unsigned short /*type*/,unsigned /*attribs*/) { return false; }
+	static void get(dbi_result /*res*/,int /*pos*/,T &/*v*/) {}
+};
+
+template<>
+struct fetch_traits<long long> {
+	static bool direct(unsigned short type,unsigned /*attribs*/) { return type==DBI_TYPE_INTEGER; }
+	static void get(dbi_result res,int pos,long long &v) { v=dbi_result_get_longlong_idx(res,pos); }
+};
+
+template<>
+struct fetch_traits<double> {
+	static bool direct(unsigned short type,unsigned attribs)
+	{
+		return type==DBI_TYPE_DECIMAL && (attribs & DBI_DECIMAL_SIZE8);
+	}
+	static void get(dbi_result res,int pos,double &v) { v=dbi_result_get_double_idx(res,pos); }
+};
+
+template<>
+struct fetch_traits<std::string> {
+	static bool direct(unsigned short type,unsigned /*attribs*/) { return type==DBI_TYPE_STRING; }
+	static void get(dbi_result res,int pos,std::string &v)
+	{
+		char const *s=dbi_result_get_string_idx(res,pos);
+		if(!s)
+			return;
+		size_t len=dbi_result_get_field_length_idx(res,pos);
+		if(len==DBI_LENGTH_ERROR)
+			len=std::strlen(s);
+		v.assign(s,len);
+	}
+};
+
+///
+/// \brief Reader of a single column into type T, the conversion is selected once by resolve()
+///
+template<typename T>
+class column_reader {
+public:
+	column_reader() : direct(false) {}
+	///
+	/// Select conversion for the column at position \a pos of \a s
+	///
+	void resolve(schema const &s,int pos)
+	{
+		direct=fetch_traits<T>::direct(s.type(pos),s.attribs(pos));
+	}
+	///
+	/// Read column \a pos of row \a r into \a v, returns false if the value is NULL
+	///
+	bool read(row &r,int pos,T &v)
+	{
+		if(!direct)
+			return r.fetch(pos,v);
+		if(r.isnull(pos))
+			return false;
+		fetch_traits<T>::get(r.get_dbi_result(),pos,v);
+		return true;
+	}
+private:
+	bool direct;
+};
+
 ///
 /// \brief This class holds query result and allows iterating over its rows
 ///
@@ -184,13 +387,24 @@ public:
 	///
 	/// Create empty result
 	///
-	result() : res(NULL) {};
+	result() :
+		res(NULL),
+		source(NULL),
+		stream_owner(NULL),
+		stream_batch(0),
+		stream_end(true),
+		outputs_ready(false),
+		mapped_key(NULL),
+		members_ready(false)
+	{
+	}
 	///
 	/// Destroy result
 	///
 	~result();
 	///
-	/// Get number of rows in the returned result
+	/// Get number of rows in the returned result. Throws dbixx_error for streaming results
+	/// as the number of rows is not known in advance.
 	///
 	unsigned long long rows();
 	///
@@ -201,18 +415,273 @@ public:
 	/// Fetch next row and store it into \a r. Returns false if no more rows remain.
 	///
 	bool next(row &r);
+	///
+	/// Fetch up to \a n next rows into the column buffers of \a b. The buffers are cleared first.
+	/// Returns number of fetched rows, 0 if no more rows remain.
+	///
+	/// \code
+	///  std::vector<int> ids;
+	///  std::vector<std::string> names;
+	///  std::vector<bool> names_null;
+	///  dbixx::batch b;
+	///  b.column(ids).column(names,&names_null);
+	///  while(res.fetch_batch(1000,b) > 0) {
+	///     process(ids,names,names_null);
+	///  }
+	/// \endcode
+	///
+	size_t fetch_batch(size_t n,batch &b);
+	///
+	/// Copy all remaining rows of the result into \a t, replacing its previous content.
+	/// The table remains valid after the result is destroyed, see table class.
+	///
+	/// \code
+	///  dbixx::table t;
+	///  sql<<"SELECT id,name FROM users",res;
+	///  res.materialize(t);
+	///  for(size_t i=0;i<t.rows();i++)
+	///     std::cout << t.get<int>(i,1) << t.get<std::string>(i,2) << std::endl;
+	/// \endcode
+	///
+	void materialize(table &t);
+	///
+	/// Bind variable \a v to the next column of the result, next() would store column values to
+	/// the bound variables. If \a isnull is not NULL it receives the NULL flag of the value, otherwise
+	/// the variable remains unchanged for NULL values.
+	///
+	/// The conversion of each column is selected once per result according to the type of the variable
+	/// and the type of the column, so there is no per value type dispatch.
+	///
+	/// \code
+	///  int id; std::string name;
+	///  sql<<"SELECT id,name FROM users",res;
+	///  res.into(id).into(name);
+	///  while(res.next()) {
+	///      std::cout << id << " " << name << std::endl;
+	///  }
+	/// \endcode
+	///
+	/// The bindings remain valid for following queries fetched into this result, call unbind()
+	/// to remove them.
+	///
+	template<typename T>
+	result &into(T &v,bool *isnull=NULL)
+	{
+		outputs.push_back(NULL);
+		outputs.back()=new typed_output<T>(v,isnull);
+		outputs_ready=false;
+		return *this;
+	}
+	///
+	/// Remove all variables bound with into()
+	///
+	void unbind();
+	///
+	/// Fetch next row into the variables bound with into(). Returns false if no more rows remain.
+	///
+	bool next();
+	///
+	/// Fetch next row into the fields of structure \a obj that has a mapping, see DBIXX_MAP_BEGIN.
+	/// Returns false if no more rows remain. Fields are read from the columns in order they are
+	/// listed in the mapping. The field offsets and the conversions are computed once per result.
+	/// A field whose column is NULL is reset to its default value, i.e. 0, an empty string or a zeroed
+	/// std::tm; use into() with a null indicator where NULL must be told apart from these values.
+	///
+	template<typename T>
+	bool next_into(T &obj)
+	{
+		if(mapped_key!=&mapping_key<T>::id) {
+			clear_members();
+			member_collector collect(members,reinterpret_cast<char *>(&obj));
+			mapping<T>::visit(collect,obj);
+			mapped_key=&mapping_key<T>::id;
+		}
+		return fetch_members(reinterpret_cast<char *>(&obj));
+	}
+	///
+	/// Fetch all remaining rows into \a objects, each row is stored using next_into()
+	///
+	template<typename T>
+	void fetch_all(std::vector<T> &objects)
+	{
+		for(;;) {
+			objects.push_back(T());
+			if(!next_into(objects.back())) {
+				objects.pop_back();
+				break;
+			}
+		}
+	}
+	///
+	/// Get the description of the columns of this result
+	///
+	schema const &columns() { return info; }
 private:
 	dbi_result res;
-	void assign(dbi_result r);
+	session *source;
+	schema info;
+	void assign(dbi_result r,session *s);
+
+	session *stream_owner;
+	std::string cursor;
+	unsigned stream_batch;
+	bool stream_end;
+	void start_stream(session *s,std::string const &name,unsigned batch);
+	bool fetch_more();
+	void close_stream();
+
+	struct output_base {
+		virtual ~output_base() {}
+		virtual void resolve(schema const &s,int pos) = 0;
+		virtual void fetch(row &r,int pos) = 0;
+	};
+	template<typename T>
+	struct typed_output : public output_base {
+		typed_output(T &v,bool *n) : value(v), isnull(n) {}
+		virtual void resolve(schema const &s,int pos) { reader.resolve(s,pos); }
+		virtual void fetch(row &r,int pos)
+		{
+			bool null=!reader.read(r,pos,value);
+			if(isnull)
+				*isnull=null;
+		}
+		T &value;
+		bool *isnull;
+		column_reader<T> reader;
+	};
+	std::vector<output_base *> outputs;
+	bool outputs_ready;
+	row bound_row;
+
+	template<typename T>
+	struct mapping_key {
+		static char id;
+	};
+	struct member_base {
+		virtual ~member_base() {}
+		virtual void resolve(schema const &s,int pos) = 0;
+		virtual void fetch(row &r,int pos,char *base) = 0;
+	};
+	template<typename F>
+	struct typed_member : public member_base {
+		typed_member(size_t off) : offset(off) {}
+		virtual void resolve(schema const &s,int pos) { reader.resolve(s,pos); }
+		virtual void fetch(row &r,int pos,char *base)
+		{
+			F &field=*reinterpret_cast<F *>(base+offset);
+			// Don't leave the value of the previous row
+			if(!reader.read(r,pos,field))
+				field=F();
+		}
+		size_t offset;
+		column_reader<F> reader;
+	};
+	struct member_collector {
+		member_collector(std::vector<member_base *> &m,char *b) : members(m), base(b) {}
+		template<typename F>
+		member_collector &operator()(F &field)
+		{
+			members.push_back(NULL);
+			members.back()=new typed_member<F>(reinterpret_cast<char *>(&field) - base);
+			return *this;
+		}
+		std::vector<member_base *> &members;
+		char *base;
+	};
+	std::vector<member_base *> members;
+	void const *mapped_key;
+	bool members_ready;
+	void clear_members();
+	bool fetch_members(char *base);
+
 	friend class session;
+	friend class pipeline;
 };
 
 
+///
+/// \brief Set of typed column buffers filled by result::fetch_batch()
+///
+/// Each call of column() binds next column of the result to a vector. The conversion of each
+/// column is selected once per batch according to the column type.
+///
+class batch {
+	// non copyable
+	batch(batch const &);
+	batch const &operator=(batch const &);
+public:
+	///
+	/// Create batch without columns
+	///
+	batch() {}
+	~batch()
+	{
+		for(unsigned i=0;i<columns.size();i++)
+			delete columns[i];
+	}
+	///
+	/// Bind next column to \a values. If \a nulls is not NULL, it receives true for each
+	/// NULL value, otherwise NULL values are stored as T().
+	///
+	template<typename T>
+	batch &column(std::vector<T> &values,std::vector<bool> *nulls=NULL)
+	{
+		columns.push_back(NULL);
+		columns.back()=new typed_column<T>(values,nulls);
+		return *this;
+	}
+	///
+	/// Get number of bound columns
+	///
+	unsigned size() const { return columns.size(); }
+private:
+	struct column_base {
+		virtual ~column_base() {}
+		virtual void start(schema const &s,int pos,size_t n) = 0;
+		virtual void fetch(row &r,int pos) = 0;
+	};
+	template<typename T>
+	struct typed_column : public column_base {
+		typed_column(std::vector<T> &v,std::vector<bool> *n) : values(v), nulls(n) {}
+		virtual void start(schema const &s,int pos,size_t n)
+		{
+			values.clear();
+			values.reserve(n);
+			if(nulls) {
+				nulls->clear();
+				nulls->reserve(n);
+			}
+			reader.resolve(s,pos);
+		}
+		virtual void fetch(row &r,int pos)
+		{
+			values.push_back(T());
+			bool null=!reader.read(r,pos,values.back());
+			if(nulls)
+				nulls->push_back(null);
+		}
+		std::vector<T> &values;
+		std::vector<bool> *nulls;
+		column_reader<T> reader;
+	};
+
+	std::vector<column_base *> columns;
+	friend class result;
+};
+
 ///
 /// \brief Special type to bind a NULL value to column using operator,() - syntactic sugar
 ///
 struct null {};
 ///
+/// \brief Binary value to bind to column, it may contain zero bytes. The data is not copied.
+///
+struct blob {
+	blob(void const *d,size_t n) : data(d), size(n) {}
+	void const *data;
+	size_t size;
+};
+///
 /// \brief Special type to start statement execution using operator,() - syntactic sugar
 ///
 struct exec {};
@@ -231,9 +700,162 @@ std::pair<T,bool> use(T ref, bool isnull=false)
 	return std::pair<T,bool>(ref,isnull);
 }
 
+///
+/// \brief Information about an executed query that is passed to query_observer
+///
+struct query_info {
+	///
+	/// The query as it was given to session::query(), with "?" placeholders. For bulk_insert it is
+	/// the prefix followed by the row template, for the cursor commands of session::fetch_stream()
+	/// it is the command with "?" in place of its parameters, so the number of distinct values stays
+	/// bounded by the number of distinct statements
+	///
+	char const *query;
+	///
+	/// The actual text sent to the database
+	///
+	char const *text;
+	///
+	/// Time in seconds between the call of session::query() and the execution, it includes
+	/// binding of the parameters. It is negative if unknown, for example when the observer was
+	/// installed after the query was started, or for bulk_insert, pipeline and cursor commands
+	///
+	double bind_time;
+	///
+	/// Time in seconds spent in the database request, including the transfer of the result
+	///
+	double exec_time;
+	///
+	/// Number of rows returned by the query
+	///
+	unsigned long long rows;
+	///
+	/// Number of rows affected by the query
+	///
+	unsigned long long affected;
+	///
+	/// Error message if the query failed, NULL otherwise
+	///
+	char const *error;
+};
+
+///
+/// \brief Interface for monitoring of the queries executed by session, see session::observer()
+///
+class query_observer {
+public:
+	virtual ~query_observer() {}
+	///
+	/// Called after each query is executed, including failed ones. It is called from the thread that
+	/// uses the session, so an observer shared between several sessions should be thread safe.
+	/// The function should not throw.
+	///
+	virtual void on_query(query_info const &info) = 0;
+};
+
+///
+/// \brief Policy of automatic retry of failed queries, see session::retry()
+///
+/// A failed query is executed again if its error message contains one of \a transient_errors,
+/// or if the connection was lost, in which case the session reconnects first. The connection is
+/// considered lost when libdbi reports DBI_ERROR_NOCONN or a trivial query fails on it; ping()
+/// is not used as some drivers reset the connection on ping and report success. Before each retry
+/// the session waits for a delay that starts at \a initial_delay and grows \a multiplier times
+/// with each attempt up to \a max_delay seconds, reduced by a random part of up to \a jitter
+/// of its value so sessions that failed together do not retry at the same moment.
+///
+/// Queries are never retried inside transaction. Queries executed with exec() are retried only
+/// if \a retry_writes is set or the query was marked with session::idempotent(). A lost connection
+/// is not reconnected while results or rows fetched from the session are alive, as libdbi would
+/// free them with the connection, so such queries fail without retry.
+///
+struct retry_policy {
+	retry_policy() :
+		max_attempts(1),
+		initial_delay(0.05),
+		max_delay(2.0),
+		multiplier(2.0),
+		jitter(0.5),
+		retry_writes(false)
+	{
+	}
+	///
+	/// Total number of attempts to execute a query, 1 disables retries
+	///
+	unsigned max_attempts;
+	///
+	/// Delay before first retry in seconds
+	///
+	double initial_delay;
+	///
+	/// Maximal delay between retries in seconds
+	///
+	double max_delay;
+	///
+	/// Growth factor of the delay
+	///
+	double multiplier;
+	///
+	/// Part of the delay, between 0 and 1, that is randomized
+	///
+	double jitter;
+	///
+	/// Retry all statements executed with exec()
+	///
+	bool retry_writes;
+	///
+	/// Parts of error messages that should be retried without reconnecting, for example
+	/// "deadlock detected" or "database is locked"
+	///
+	std::vector<std::string> transient_errors;
+};
+
+///
+/// \brief libdbi instance that loads the database drivers, see session::session(instance &)
+///
+/// Each instance is initialized with libdbi's reentrant API and keeps its own set of loaded
+/// drivers, so several libraries or subsystems of a program do not share the global
+/// libdbi state. The sessions created from an instance must be destroyed before it.
+///
+/// Sessions created without an explicit instance use global(), which is created on first
+/// use in a thread safe way and is never destroyed, so sessions may live in static objects.
+///
+class instance {
+	// non copyable
+	instance(instance const &);
+	instance const &operator=(instance const &);
+public:
+	///
+	/// Initialize libdbi loading the drivers from \a driver_dir, NULL for default location.
+	/// Throws dbixx_error on failure.
+	///
+	instance(char const *driver_dir=NULL);
+	///
+	/// Unload the drivers
+	///
+	~instance();
+	///
+	/// Get low level libdbi instance object
+	///
+	dbi_inst get_dbi_inst() { return inst; }
+	///
+	/// Get the default instance used by sessions created without an instance
+	///
+	static instance &global();
+private:
+	dbi_inst inst;
+};
+
 ///
 /// \brief Class that represents connection session
 ///
+/// Concurrency model: a session, together with its statements and the results and rows it
+/// returned, must not be shared between threads. The session does no locking, and libdbi updates
+/// the error state of the connection even when the values of a result are read. It may be handed
+/// over to another thread once the previous one stopped using it. Threads that work with the
+/// database concurrently should take their own sessions from a pool. Different sessions may be
+/// used by different threads freely, including the sessions that share an instance.
+///
 class session {
 	// non copyable
 	session(session const &);
@@ -255,6 +877,15 @@ public:
 	///
 	session(std::string const &backend_or_connection_string);
 	///
+	/// Create unconnected session that loads its driver from libdbi instance \a inst
+	///
+	session(instance &inst);
+	///
+	/// Create session that loads its driver from libdbi instance \a inst, \a backend_or_connection_string
+	/// is handled as in session(std::string const &)
+	///
+	session(std::string const &backend_or_connection_string,instance &inst);
+	///
 	/// Destroy the session and close the connection
 	///
 	~session();
@@ -307,11 +938,17 @@ public:
 	///
 	void connect();
 	///
-	/// Reconnect to database, useful if the DB was disconnected
+	/// Reconnect to database, useful if the DB was disconnected. The results and rows fetched
+	/// from the session should be destroyed before, as libdbi frees them with the connection.
 	///
 	void reconnect();
 	///
-	/// Close connection
+	/// Check if the connection to database is alive, returns false if the session is not connected
+	/// or the connection was lost.
+	///
+	bool ping();
+	///
+	/// Close connection, the results and rows fetched from the session should be destroyed before
 	///
 	void close();
 	
@@ -347,49 +984,159 @@ public:
 	unsigned long long affected() { return affected_rows ;}
 
 	///
-	/// Bind a string parameter at next position in query
+	/// Set the maximal number of parsed query templates kept by the session, default is 64.
 	///
-	void bind(std::string const &s,bool isnull=false);
+	/// Each query passed to query() is split to the literal parts and the "?" placeholders
+	/// once and the result is cached by the query text, so executing same query many times
+	/// with different parameters only splices the bound values. Setting the size to 0
+	/// disables the cache.
 	///
-	/// Bind a numeric parameter at next position in query
+	void template_cache_size(size_t n);
 	///
-	void bind(int v,bool isnull=false);
+	/// Get number of queries that were found in the template cache
 	///
-	/// Bind a numeric parameter at next position in query
+	unsigned long long template_cache_hits() { return template_hits; }
 	///
-	void bind(unsigned v,bool isnull=false);
+	/// Get number of queries that had to be parsed
 	///
-	/// Bind a numeric parameter at next position in query
+	unsigned long long template_cache_misses() { return template_misses; }
+
 	///
-	void bind(long v,bool isnull=false);
+	/// Enable or disable server side prepared statements, disabled by default.
 	///
-	/// Bind a numeric parameter at next position in query
+	/// When enabled and the backend supports it (currently "pgsql"), each cached query
+	/// template that has parameters is prepared once per connection using PREPARE statement
+	/// and executed with EXECUTE, so the server parses and plans it only once. The server
+	/// must be able to deduce the type of each parameter from the query. If preparation fails
+	/// the error is reported and the query falls back to plain execution afterwards.
 	///
-	void bind(unsigned long v,bool isnull=false);
+	/// For other backends the setting is ignored and the parameters are spliced into
+	/// the query text as usual.
 	///
-	/// Bind a numeric parameter at next position in query
+	void server_prepare(bool enable);
 	///
-	void bind(long long int v,bool isnull=false);
+	/// Check if server side prepared statements are enabled
 	///
-	/// Bind a numeric parameter at next position in query
+	bool server_prepare() { return use_server_prepare; }
+
 	///
-	void bind(unsigned long long v,bool isnull=false);
+	/// Set observer \a o that is notified about every executed query, NULL disables
+	/// monitoring. The observer is not owned by the session.
 	///
-	/// Bind a numeric parameter at next position in query
+	void observer(query_observer *o) { monitor=o; }
 	///
-	void bind(double v,bool isnull=false);
+	/// Get current query observer
 	///
-	/// Bind a numeric parameter at next position in query
+	query_observer *observer() { return monitor; }
+
 	///
-	void bind(long double v,bool isnull=false);
+	/// Set retry policy \a p for failed queries, by default queries are not retried
 	///
-	/// Bind a date-time parameter at next position in query
+	void retry(retry_policy const &p) { retry_settings=p; }
+	///
+	/// Get current retry policy
+	///
+	retry_policy const &retry() { return retry_settings; }
+	///
+	/// Mark the current query as safe to execute more then once, so exec() may retry it
+	/// according to the retry policy. The mark is cleared by next call of query().
+	///
+	void idempotent(bool v=true) { state.query_idempotent=v; }
+	///
+	/// Get number of queries executed again according to the retry policy
+	///
+	unsigned long long retries() { return retries_counter; }
+
+	///
+	/// Set cache \a c used by fetch(table &) and invalidated by exec(), NULL disables caching.
+	/// The cache is not owned by the session and may be shared between sessions, see query_cache.
+	///
+	/// The cache is not used inside transaction, and the tables modified during transaction
+	/// are invalidated again when it is committed.
+	///
+	void cache(query_cache *c) { results_cache=c; }
+	///
+	/// Get current query cache
+	///
+	query_cache *cache() { return results_cache; }
+
+	///
+	/// Send reads to replicas from set \a r, NULL sends all queries to this session's connection.
+	/// The set is not owned by the session and may be shared between sessions, see replica_set.
+	///
+	/// The queries executed by fetch(result &), fetch(table &) and single() outside of transaction
+	/// are executed on one of the replicas, unless they modify data like "INSERT ... RETURNING".
+	/// Everything else, including all queries inside transaction, uses this session's connection
+	/// as the primary. The session opens its own connection to each
+	/// replica when it is first used.
+	///
+	/// Note: replicas may lag behind the primary, so a read that must see a preceding write should be
+	/// done inside transaction. The results and rows fetched from replicas should be destroyed before
+	/// the set is changed, as the connections to the replicas are closed then.
+	///
+	void replicas(replica_set *r);
+	///
+	/// Get current replica set
+	///
+	replica_set *replicas() { return read_replicas; }
+
+	///
+	/// Bind a string parameter at next position in query
+	///
+	void bind(std::string const &s,bool isnull=false);
+	///
+	/// Bind a numeric parameter at next position in query
+	///
+	void bind(int v,bool isnull=false);
+	///
+	/// Bind a numeric parameter at next position in query
+	///
+	void bind(unsigned v,bool isnull=false);
+	///
+	/// Bind a numeric parameter at next position in query
+	///
+	void bind(long v,bool isnull=false);
+	///
+	/// Bind a numeric parameter at next position in query
+	///
+	void bind(unsigned long v,bool isnull=false);
+	///
+	/// Bind a numeric parameter at next position in query
+	///
+	void bind(long long int v,bool isnull=false);
+	///
+	/// Bind a numeric parameter at next position in query
+	///
+	void bind(unsigned long long v,bool isnull=false);
+	///
+	/// Bind a numeric parameter at next position in query
+	///
+	void bind(double v,bool isnull=false);
+	///
+	/// Bind a numeric parameter at next position in query
+	///
+	void bind(long double v,bool isnull=false);
+	///
+	/// Bind a date-time parameter at next position in query
 	///
 	void bind(std::tm const &time,bool isnull=false);
 	///
 	/// Bind a NULL parameter at next position in query, \a isnull is just for consistency, don't use it.
 	///
 	void bind(null const &,bool isnull=true);
+	///
+	/// Bind a binary parameter at next position in query
+	///
+	void bind(blob const &v,bool isnull=false);
+	///
+	/// Bind all fields of a mapped structure at next positions in query, see fields()
+	///
+	template<typename T>
+	void bind(mapped<T> const &m,bool isnull=false)
+	{
+		bind_visitor v(*this,isnull);
+		mapping<T>::visit(v,const_cast<T &>(m.object));
+	}
 
 	///
 	/// Execute the statement
@@ -401,6 +1148,29 @@ public:
 	///
 	void fetch(result &res);
 
+	///
+	/// Fetch query result into table \a t, see result::materialize(). If the cache is set
+	/// the result is taken from the cache when available, otherwise it is stored there.
+	///
+	void fetch(table &t);
+
+	///
+	/// Fetch query result into \a res without loading all rows into memory at once.
+	///
+	/// For "pgsql" backend the query is executed using server side cursor and the rows are
+	/// transferred in batches of \a batch rows as result::next() advances, so the memory
+	/// used by the client is bounded by a single batch. For other backends, and for queries
+	/// that use server side prepared statements, it is same as fetch(res).
+	///
+	/// The query must be executed inside a transaction, otherwise dbixx_error is thrown,
+	/// and the result must be read before the transaction ends as the cursor is closed
+	/// with it.
+	///
+	/// Note: the session must not be destroyed before the streaming result is, and the
+	/// number of rows in such result is not available.
+	///
+	void fetch_stream(result &res,unsigned batch=1000);
+
 	///
 	/// Fetch a single row from query. If no rows where selected returns false,
 	/// if more then one row is available, throws dbixx_error, If exactly one 
@@ -438,6 +1208,10 @@ public:
 	///	
 	void operator,(result &res) { fetch(res); }
 	///
+	/// Syntactic sugar for fetching result into table - calling fetch(t)
+	///	
+	void operator,(table &t) { fetch(t); }
+	///
 	/// Syntactic sugar for fetching a single row - calling single(r)
 	///	
 	bool operator,(row &r) { return single(r); }
@@ -454,35 +1228,584 @@ public:
 	template<typename T>
 	session &operator,(std::pair<T,bool> p) { bind(p.first,p.second); return *this; }
 private:
+	struct query_state;
 	template<typename T>
-	void do_bind(T v,bool);
-
-	std::string query_in;
-	unsigned pos_read;
-	std::string escaped_query;
-	unsigned pos_write;
-	bool ready_for_input;
-	bool complete;
+	void do_bind(query_state &st,T const &v,bool);
+
+	struct bind_visitor {
+		bind_visitor(session &s,bool n) : sql(s), isnull(n) {}
+		template<typename F>
+		bind_visitor &operator()(F const &field) { sql.bind(field,isnull); return *this; }
+		session &sql;
+		bool isnull;
+	};
+
+	//
+	// Query split by "?" placeholders, chunks.size() is number of placeholders + 1
+	//
+	struct query_template {
+		query_template() : text(NULL), prepared_id(0), prepared_generation(0), prepare_failed(false) {}
+		std::string const *text;
+		std::vector<std::string> chunks;
+		unsigned prepared_id;
+		unsigned prepared_generation;
+		bool prepare_failed;
+	};
+	typedef std::list<query_template> templates_type;
+	typedef std::map<std::string,templates_type::iterator> templates_index_type;
+
+	//
+	// The query being built, it is kept apart from the connection so the connection
+	// does not depend on the state of the query
+	//
+	struct query_state {
+		query_state() :
+			current_template(NULL),
+			current_chunk(0),
+			native_query(false),
+			ready_for_input(false),
+			complete(false),
+			query_idempotent(false),
+			query_started(0)
+		{
+		}
+		query_template *current_template;
+		unsigned current_chunk;
+		bool native_query;
+		std::string escaped_query;
+		bool ready_for_input;
+		bool complete;
+		bool query_idempotent;
+		double query_started;
+		void escape();
+		void check_input();
+		std::string const &text() const
+		{
+			return current_template ? *current_template->text : escaped_query;
+		}
+	};
+
+	templates_type templates;
+	templates_index_type templates_index;
+	size_t templates_limit;
+	unsigned long long template_hits;
+	unsigned long long template_misses;
+	query_template uncached_template;
+	std::string uncached_text;
+
+	query_state state;
+	bool use_server_prepare;
+	unsigned statements_counter;
+	unsigned conn_generation;
 	unsigned long long affected_rows;
 
 
 	std::string backend;
+	instance *inst;
 	dbi_conn conn;
 	std::map<std::string,std::string> string_params; 
 	std::map<std::string,int> numeric_params; 
 	void check_open();
-	void error();
-	void escape();
-	void check_input();
+	void error(std::string const &q);
+	void init();
+	void open(std::string const &backend_or_conn_str);
+	friend class bulk_insert;
+	friend class pipeline;
+	query_template &get_template(std::string const &q);
+	static void parse_template(std::string const &q,query_template &t);
+	void evict_templates(size_t n);
+	unsigned next_statement_id();
+	void prepare_native(query_state &st);
+	void deallocate_native(query_template const &t);
+	dbi_result send(std::string const &q,std::string &error);
+	int last_error;
+	bool alive();
+	void release(dbi_result res);
+	unsigned held_results;
+	void attach();
+	void detach(dbi_result res);
+	dbi_result run(query_state &st,bool read=false,session **source=NULL);
+	dbi_result run_once(query_state &st);
+	bool recover(query_state &st,dbixx_error const &e,bool read,unsigned attempt);
+	retry_policy retry_settings;
+	unsigned long long retries_counter;
+	unsigned retry_seed;
+	unsigned long long exec(query_state &st);
+	void fetch(query_state &st,result &r);
+	void fetch(query_state &st,table &t);
+	bool single(query_state &st,row &r);
+	void exec_text(std::string &q,std::string const &key);
+	dbi_result raw_query(std::string const &q,std::string const &key);
+	unsigned transactions;
+	query_observer *monitor;
+	void notify(char const *q,char const *text,double started,double sent,dbi_result res,char const *error);
+	query_cache *results_cache;
+	std::vector<std::string> written_tags;
+	bool written_all;
+	void invalidate_cached(std::string const &text);
+	static bool writes(std::string const &text);
+	void end_transaction(bool commited);
+	replica_set *read_replicas;
+	std::vector<session *> replica_sessions;
+	dbi_result query_replica(query_state &st,session *&source);
+	void close_replicas();
+	bool recycle();
+	friend class pool;
+	friend class row;
+	friend class result;
+	friend class transaction;
+	friend class statement;
+
+};
+
+///
+/// \brief Query with its own parameters and buffers that is executed using a session
+///
+/// The statement parses its query once and keeps the text with the bound values in its
+/// own buffer, so executing it many times does not parse the query again or allocate memory
+/// once the buffer has grown to the needed size. It does not use the query state of the
+/// session, so a statement can be built and executed while the result of another statement
+/// or of the session itself is being read.
+///
+/// \code
+///  dbixx::statement ins(sql,"INSERT INTO users(id,name) VALUES(?,?)");
+///  for(unsigned i=0;i<users.size();i++) {
+///      ins.reset();
+///      ins,users[i].id,users[i].name,dbixx::exec();
+///  }
+/// \endcode
+///
+/// A statement is used by the thread that uses its session, see session, and the session must
+/// not be destroyed before its statements.
+///
+class statement {
+	// non copyable
+	statement(statement const &);
+	statement const &operator=(statement const &);
+public:
+	///
+	/// Create a statement for query \a query executed by session \a s, parameters are marked
+	/// with "?" as in session::query()
+	///
+	statement(session &s,std::string const &query);
+	///
+	/// Destroy the statement and release its server side prepared statement if any
+	///
+	~statement();
+	///
+	/// Clear the bound values so the statement can be bound again, the memory of the buffer is kept
+	///
+	void reset();
+	///
+	/// Get the query of the statement
+	///
+	std::string const &query() const { return text; }
+	///
+	/// Bind a string parameter at next position in query
+	///
+	void bind(std::string const &v,bool isnull=false);
+	///
+	/// Bind a numeric parameter at next position in query
+	///
+	void bind(int v,bool isnull=false);
+	///
+	/// Bind a numeric parameter at next position in query
+	///
+	void bind(unsigned v,bool isnull=false);
+	///
+	/// Bind a numeric parameter at next position in query
+	///
+	void bind(long v,bool isnull=false);
+	///
+	/// Bind a numeric parameter at next position in query
+	///
+	void bind(unsigned long v,bool isnull=false);
+	///
+	/// Bind a numeric parameter at next position in query
+	///
+	void bind(long long v,bool isnull=false);
+	///
+	/// Bind a numeric parameter at next position in query
+	///
+	void bind(unsigned long long v,bool isnull=false);
+	///
+	/// Bind a numeric parameter at next position in query
+	///
+	void bind(double v,bool isnull=false);
+	///
+	/// Bind a numeric parameter at next position in query
+	///
+	void bind(long double v,bool isnull=false);
+	///
+	/// Bind a date-time parameter at next position in query
+	///
+	void bind(std::tm const &v,bool isnull=false);
+	///
+	/// Bind a NULL parameter at next position in query
+	///
+	void bind(null const &,bool isnull=true);
+	///
+	/// Bind a binary parameter at next position in query
+	///
+	void bind(blob const &v,bool isnull=false);
+	///
+	/// Bind all fields of a mapped structure at next positions in query, see fields()
+	///
+	template<typename T>
+	void bind(mapped<T> const &m,bool isnull=false)
+	{
+		bind_visitor v(*this,isnull);
+		mapping<T>::visit(v,const_cast<T &>(m.object));
+	}
+	///
+	/// Execute the statement, it may be executed again with the same values
+	///
+	void exec();
+	///
+	/// Fetch the result of the statement into \a res, see session::fetch(result &)
+	///
+	void fetch(result &res);
+	///
+	/// Fetch the result of the statement into table \a t, see session::fetch(table &)
+	///
+	void fetch(table &t);
+	///
+	/// Fetch a single row, see session::single()
+	///
+	bool single(row &r);
+	///
+	/// Get number of rows affected by last execution of the statement
+	///
+	unsigned long long affected() { return affected_rows; }
+	///
+	/// Mark the statement as safe to execute more then once, so exec() may retry it according
+	/// to the retry policy of the session, see session::idempotent(). The mark is kept by reset().
+	///
+	void idempotent(bool v=true) { state.query_idempotent=v; }
+
+	///
+	/// Syntactic sugar for bind(v)
+	///
+	statement &operator,(std::string const &v) { bind(v,false); return *this; }
+	///
+	/// Syntactic sugar for bind(v)
+	///
+	statement &operator,(char const *v) { bind(v,false); return *this; }
+	///
+	/// Syntactic sugar for bind(v)
+	///
+	statement &operator,(std::tm const &v) { bind(v,false); return *this; }
+	///
+	/// Syntactic sugar for calling exec() function.
+	///
+	void operator,(dbixx::exec const ) { exec(); }
+	///
+	/// Syntactic sugar for fetching result - calling fetch(res)
+	///
+	void operator,(result &res) { fetch(res); }
+	///
+	/// Syntactic sugar for fetching result into table - calling fetch(t)
+	///
+	void operator,(table &t) { fetch(t); }
+	///
+	/// Syntactic sugar for fetching a single row - calling single(r)
+	///
+	bool operator,(row &r) { return single(r); }
+	///
+	/// Syntactic sugar for bind(v)
+	///
+	template<typename T>
+	statement &operator,(T v) { bind(v,false); return *this; }
+	///
+	/// Syntactic sugar for bind(p.first,p.second), usually used with use() function
+	///
+	template<typename T>
+	statement &operator,(std::pair<T,bool> p) { bind(p.first,p.second); return *this; }
+private:
+	struct bind_visitor {
+		bind_visitor(statement &s,bool n) : st(s), isnull(n) {}
+		template<typename F>
+		bind_visitor &operator()(F const &field) { st.bind(field,isnull); return *this; }
+		statement &st;
+		bool isnull;
+	};
+
+	session &sql;
+	std::string text;
+	session::query_template tmpl;
+	session::query_state state;
+	unsigned long long affected_rows;
+};
+
+///
+/// \brief Bulk insert helper that packs many rows into a single multi-row INSERT statement.
+///
+/// The rows are bound one after another using the row template and collected into one
+/// statement "prefix row_1,row_2,...". The statement is executed once it holds \a max_rows
+/// rows or its size exceeds \a max_bytes, saving the round trip to the server per row.
+///
+/// \code
+///  dbixx::bulk_insert ins(sql,"INSERT INTO users(id,name) VALUES","(?,?)");
+///  for(int i=0;i<n;i++)
+///      ins,ids[i],names[i];
+///  ins.flush();
+///  std::cout << ins.affected() << " rows inserted" << std::endl;
+/// \endcode
+///
+/// Note: the session should not be used for other queries while the bulk insert
+/// is in progress. Rows that were not flushed explicitly are discarded in destructor.
+///
+class bulk_insert {
+	// non copyable
+	bulk_insert(bulk_insert const &);
+	bulk_insert const &operator=(bulk_insert const &);
+public:
+	///
+	/// Create a bulk insert on session \a s. The statement starts with \a prefix, for example
+	/// "INSERT INTO foo(a,b) VALUES" and each row is described by \a row_template, for example "(?,?)"
+	///
+	bulk_insert(session &s,std::string const &prefix,std::string const &row_template,
+		unsigned max_rows=500,size_t max_bytes=1024*1024);
+	///
+	/// Bind a value \a v at next position of the current row, see session::bind()
+	///
+	template<typename T>
+	void bind(T const &v,bool isnull=false)
+	{
+		begin_row();
+		sql.bind(v,isnull);
+		end_row();
+	}
+	///
+	/// Execute all pending rows
+	///
+	void flush();
+	///
+	/// Get number of rows bound but not executed yet
+	///
+	unsigned pending() { return pending_rows; }
+	///
+	/// Get total number of rows affected by all executed statements
+	///
+	unsigned long long affected() { return affected_rows; }
+
+	///
+	/// Syntactic sugar for bind(v)
+	///
+	template<typename T>
+	bulk_insert &operator,(T const &v) { bind(v); return *this; }
+	///
+	/// Syntactic sugar for bind(p.first,p.second), usually used with use() function
+	///
+	template<typename T>
+	bulk_insert &operator,(std::pair<T,bool> const &p) { bind(p.first,p.second); return *this; }
+	///
+	/// Syntactic sugar for flush()
+	///
+	void operator,(dbixx::exec const &) { flush(); }
+private:
+	void begin_row();
+	void end_row();
 
+	session &sql;
+	std::string prefix;
+	std::string row_template;
+	std::string batch_key;
+	unsigned max_rows;
+	size_t max_bytes;
+	std::string batch;
+	unsigned pending_rows;
+	bool row_open;
+	unsigned long long affected_rows;
 };
 
+///
+/// \brief Queue of independent statements that are built first and executed together.
+///
+/// Statements are prepared using the session's parameter binding and each one gets its own
+/// result, or affected rows count for statements executed like session::exec().
+///
+/// \code
+///  dbixx::result users,groups;
+///  dbixx::pipeline p(sql);
+///  p<<"SELECT * FROM users WHERE id=?",id,users;
+///  p<<"SELECT * FROM groups WHERE user_id=?",id,groups;
+///  p<<"UPDATE stats SET hits=hits+1 WHERE id=?",id,exec();
+///  p.run();
+/// \endcode
+///
+/// libdbi provides a single result per request, so run() executes the statements one after
+/// another on the session, while run(async_session &) sends them concurrently over several
+/// pooled connections, so their round trips overlap. In the later case the statements should
+/// not depend on each other.
+///
+/// A result refers to the connection that produced it, so the statements added with add(result &)
+/// are always executed on the pipeline's session, and their results must be destroyed before
+/// that session. The statements added with add(table &) are materialized into the table by the
+/// connection that executed them, so only these and the statements without results are sent to
+/// the pooled connections by run(async_session &).
+///
+/// Like session::exec(), the statements without results drop the results cached by the session's
+/// query_cache for the tables they write, see session::cache().
+///
+/// Note: the result and table objects must remain valid till run() completes.
+///
+class pipeline {
+	// non copyable
+	pipeline(pipeline const &);
+	pipeline const &operator=(pipeline const &);
+public:
+	///
+	/// Create a pipeline that uses session \a s for building and executing statements
+	///
+	pipeline(session &s);
+	///
+	/// Start new statement \a q, see session::query()
+	///
+	void query(std::string const &q);
+	///
+	/// Bind a value \a v at next position of the current statement, see session::bind()
+	///
+	template<typename T>
+	void bind(T const &v,bool isnull=false) { sql.bind(v,isnull); }
+	///
+	/// Complete current statement, its result would be stored in \a r
+	///
+	void add(result &r);
+	///
+	/// Complete current statement, its result would be stored in table \a t, see result::materialize()
+	///
+	void add(table &t);
+	///
+	/// Complete current statement, it would be executed like session::exec()
+	///
+	void add();
+	///
+	/// Execute all queued statements sequentially using the session
+	///
+	void run();
+	///
+	/// Execute all queued statements concurrently using the workers of \a a, the statements
+	/// with results stored in result objects are executed meanwhile using the session. Waits till
+	/// all statements are completed, if some of them failed, the error of one of them is thrown.
+	///
+	void run(async_session &a);
+	///
+	/// Get number of queued statements
+	///
+	unsigned size() { return entries.size(); }
+	///
+	/// Get number of rows affected by statement number \a i (starting from 0) after run()
+	///
+	unsigned long long affected(unsigned i);
+	///
+	/// Remove all queued statements
+	///
+	void clear() { entries.clear(); }
+
+	///
+	/// Syntactic sugar for query(q)
+	///
+	pipeline &operator<<(std::string const &q) { query(q); return *this; }
+	///
+	/// Syntactic sugar for bind(v)
+	///
+	template<typename T>
+	pipeline &operator,(T const &v) { bind(v); return *this; }
+	///
+	/// Syntactic sugar for bind(p.first,p.second), usually used with use() function
+	///
+	template<typename T>
+	pipeline &operator,(std::pair<T,bool> const &p) { bind(p.first,p.second); return *this; }
+	///
+	/// Syntactic sugar for add(r)
+	///
+	void operator,(result &r) { add(r); }
+	///
+	/// Syntactic sugar for add(t)
+	///
+	void operator,(table &t) { add(t); }
+	///
+	/// Syntactic sugar for add()
+	///
+	void operator,(dbixx::exec const &) { add(); }
+private:
+	struct entry {
+		std::string query;
+		std::string text;
+		result *res;
+		table *tab;
+		unsigned long long affected;
+	};
+	void push(result *r,table *t);
+	void invalidate();
+	static void execute(session &s,entry &e);
+
+	session &sql;
+	std::vector<entry> entries;
+
+	friend class pipeline_task;
+};
+
+template<typename T>
+char result::mapping_key<T>::id;
+
+///
+/// Start the mapping of structure \a type to the query columns. It should be used in global namespace
+/// followed by DBIXX_FIELD for each mapped member and DBIXX_MAP_END(), for example:
+///
+/// \code
+///  struct user {
+///      int id;
+///      std::string name;
+///      std::tm created;
+///  };
+///
+///  DBIXX_MAP_BEGIN(user)
+///      DBIXX_FIELD(id)
+///      DBIXX_FIELD(name)
+///      DBIXX_FIELD(created)
+///  DBIXX_MAP_END()
+///
+///  user u;
+///  sql<<"SELECT id,name,created FROM users",res;
+///  while(res.next_into(u)) {
+///      ...
+///  }
+///  sql<<"INSERT INTO users(id,name,created) VALUES(?,?,?)",dbixx::fields(u),dbixx::exec();
+/// \endcode
+///
+#define DBIXX_MAP_BEGIN(type) \
+	namespace dbixx { \
+	template<> \
+	struct mapping<type> { \
+		template<typename Visitor> \
+		static void visit(Visitor &dbixx_visitor,type &dbixx_object) \
+		{
+///
+/// Map member \a member of the structure, see DBIXX_MAP_BEGIN
+///
+#define DBIXX_FIELD(member) \
+			dbixx_visitor(dbixx_object.member);
+///
+/// End the mapping of the structure, see DBIXX_MAP_BEGIN
+///
+#define DBIXX_MAP_END() \
+		} \
+	}; \
+	}
+
 ///
 /// \brief Transaction scope guard.
 ///
 /// It automatically rollbacks the transaction during stack unwind
 /// if it wasn't committed
 ///
+/// Transactions may be nested: a transaction started while another one is active on the
+/// same session creates a savepoint, its commit releases the savepoint and its rollback
+/// undoes only the changes made since the savepoint. Changes become permanent when
+/// the outermost transaction is committed.
+///
 class transaction {
 	// non copyable
 	transaction(transaction const &);
@@ -507,7 +1830,9 @@ public:
 private:
 	session &sql;
 	bool commited;
+	unsigned level;
 	void begin();
+	void savepoint(char const *command);
 };
 
 }
@@ -0,0 +1,341 @@
+#include "export.h"
+#include "util.h"
+#include <vector>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+namespace dbixx {
+
+void sink::writev(iovec const *v,int n)
+{
+	for(int i=0;i<n;i++)
+		write(static_cast<char const *>(v[i].iov_base),v[i].iov_len);
+}
+
+void fd_sink::write(char const *data,size_t n)
+{
+	while(n > 0) {
+		ssize_t r=::write(fd_,data,n);
+		if(r < 0) {
+			if(errno==EINTR)
+				continue;
+			throw dbixx_error(std::string("Failed to write exported data: ")+strerror(errno));
+		}
+		data+=r;
+		n-=r;
+	}
+}
+
+void fd_sink::writev(iovec const *v,int n)
+{
+	std::vector<iovec> tmp(v,v+n);
+	iovec *p=&tmp[0];
+	while(n > 0) {
+		ssize_t r=::writev(fd_,p,n);
+		if(r < 0) {
+			if(errno==EINTR)
+				continue;
+			throw dbixx_error(std::string("Failed to write exported data: ")+strerror(errno));
+		}
+		// Skip what was written, the write may stop in the middle of a buffer
+		while(n > 0 && size_t(r) >= p->iov_len) {
+			r-=p->iov_len;
+			p++;
+			n--;
+		}
+		if(n > 0) {
+			p->iov_base=static_cast<char *>(p->iov_base)+r;
+			p->iov_len-=r;
+		}
+	}
+}
+
+void stream_sink::write(char const *data,size_t n)
+{
+	out_.write(data,n);
+	if(!out_)
+		throw dbixx_error("Failed to write exported data");
+}
+
+namespace {
+
+	class output {
+	public:
+		output(sink &s,size_t size) : out_(s), buf_(size < 1024 ? 1024 : size), used_(0) {}
+		void put(char c)
+		{
+			if(used_==buf_.size())
+				flush();
+			buf_[used_++]=c;
+		}
+		void put(char const *p,size_t n)
+		{
+			if(n <= buf_.size()-used_) {
+				memcpy(&buf_[used_],p,n);
+				used_+=n;
+			}
+			else {
+				put_ref(p,n);
+			}
+		}
+		//
+		// Large values are passed to the sink along with the buffer rather then copied
+		//
+		void put_large(char const *p,size_t n)
+		{
+			if(n < buf_.size()/4)
+				put(p,n);
+			else
+				put_ref(p,n);
+		}
+		//
+		// Get space for at least 80 bytes of formatted data
+		//
+		char *reserve()
+		{
+			if(buf_.size()-used_ < 80)
+				flush();
+			return &buf_[used_];
+		}
+		void commit(char *end)
+		{
+			used_=end-&buf_[0];
+		}
+		void flush()
+		{
+			if(used_ > 0)
+				out_.write(&buf_[0],used_);
+			used_=0;
+		}
+	private:
+		void put_ref(char const *p,size_t n)
+		{
+			iovec v[2];
+			v[0].iov_base=&buf_[0];
+			v[0].iov_len=used_;
+			v[1].iov_base=const_cast<char *>(p);
+			v[1].iov_len=n;
+			out_.writev(v,2);
+			used_=0;
+		}
+
+		sink &out_;
+		std::vector<char> buf_;
+		size_t used_;
+	};
+
+	char *format_le(char *p,unsigned long long v,int bytes)
+	{
+		for(int i=0;i<bytes;i++) {
+			*p++=char(v & 0xFF);
+			v>>=8;
+		}
+		return p;
+	}
+
+	void put_csv(output &o,char const *p,size_t n)
+	{
+		bool quote = n==0;
+		for(size_t i=0;i<n && !quote;i++) {
+			char c=p[i];
+			quote = c==',' || c=='"' || c=='\n' || c=='\r';
+		}
+		if(!quote) {
+			o.put_large(p,n);
+			return;
+		}
+		o.put('"');
+		char const *end=p+n;
+		while(p < end) {
+			char const *q=static_cast<char const *>(memchr(p,'"',end-p));
+			if(!q) {
+				o.put_large(p,end-p);
+				break;
+			}
+			o.put(p,q+1-p);
+			o.put('"');
+			p=q+1;
+		}
+		o.put('"');
+	}
+
+	void put_tsv(output &o,char const *p,size_t n)
+	{
+		char const *end=p+n;
+		char const *start=p;
+		for(;p < end;p++) {
+			char e;
+			switch(*p) {
+			case '\\': e='\\'; break;
+			case '\t': e='t'; break;
+			case '\n': e='n'; break;
+			case '\r': e='r'; break;
+			default: continue;
+			}
+			o.put(start,p-start);
+			o.put('\\');
+			o.put(e);
+			start=p+1;
+		}
+		o.put_large(start,end-start);
+	}
+
+	void put_hex(output &o,unsigned char const *p,size_t n,bool escape)
+	{
+		static char const digits[]="0123456789abcdef";
+		if(escape)
+			o.put('\\');
+		o.put("\\x",2);
+		for(size_t i=0;i<n;i++) {
+			o.put(digits[p[i] >> 4]);
+			o.put(digits[p[i] & 0xF]);
+		}
+	}
+
+	void put_text(output &o,data_format f,char const *p,size_t n)
+	{
+		switch(f) {
+		case csv_format:
+			put_csv(o,p,n);
+			break;
+		case tsv_format:
+			put_tsv(o,p,n);
+			break;
+		case binary_format:
+			o.commit(format_le(o.reserve(),n,4));
+			o.put_large(p,n);
+			break;
+		}
+	}
+
+	void put_binary_number(output &o,unsigned long long bits)
+	{
+		char *p=o.reserve();
+		p=format_le(p,8,4);
+		o.commit(format_le(p,bits,8));
+	}
+}
+
+unsigned long long export_result(result &res,sink &out,data_format f,bool header,size_t buffer_size)
+{
+	schema const &info=res.columns();
+	unsigned cols=info.size();
+	output o(out,buffer_size);
+
+	if(f==binary_format) {
+		o.put("DBIXXB1\n",8);
+		o.commit(format_le(o.reserve(),cols,4));
+		for(unsigned i=1;i<=cols;i++) {
+			unsigned char type=info.type(i);
+			if(type==DBI_TYPE_INTEGER && (info.attribs(i) & DBI_INTEGER_UNSIGNED))
+				type|=unsigned_type_flag;
+			o.put(char(type));
+			put_text(o,f,info.name(i).c_str(),info.name(i).size());
+		}
+	}
+	else if(header) {
+		for(unsigned i=1;i<=cols;i++) {
+			if(i > 1)
+				o.put(f==csv_format ? ',' : '\t');
+			put_text(o,f,info.name(i).c_str(),info.name(i).size());
+		}
+		o.put('\n');
+	}
+
+	row r;
+	unsigned long long rows=0;
+	while(res.next(r)) {
+		dbi_result d=r.get_dbi_result();
+		for(unsigned pos=1;pos<=cols;pos++) {
+			if(pos > 1 && f!=binary_format)
+				o.put(f==csv_format ? ',' : '\t');
+			if(dbi_result_field_is_null_idx(d,pos)==1) {
+				if(f==tsv_format)
+					o.put("\\N",2);
+				else if(f==binary_format)
+					o.commit(format_le(o.reserve(),0xFFFFFFFFU,4));
+				continue;
+			}
+			unsigned short type=info.type(pos);
+			switch(type) {
+			case DBI_TYPE_INTEGER:
+				if(info.attribs(pos) & DBI_INTEGER_UNSIGNED) {
+					unsigned long long v=dbi_result_get_ulonglong_idx(d,pos);
+					if(f==binary_format)
+						put_binary_number(o,v);
+					else
+						o.commit(format_unsigned(o.reserve(),v));
+				}
+				else {
+					long long v=dbi_result_get_longlong_idx(d,pos);
+					if(f==binary_format)
+						put_binary_number(o,v);
+					else
+						o.commit(format_signed(o.reserve(),v));
+				}
+				break;
+			case DBI_TYPE_DECIMAL:
+				{
+					double v;
+					if(info.attribs(pos) & DBI_DECIMAL_SIZE8)
+						v=dbi_result_get_double_idx(d,pos);
+					else
+						v=dbi_result_get_float_idx(d,pos);
+					if(f==binary_format) {
+						unsigned long long bits;
+						memcpy(&bits,&v,sizeof(v));
+						put_binary_number(o,bits);
+					}
+					else {
+						o.commit(format_double(o.reserve(),v));
+					}
+				}
+				break;
+			case DBI_TYPE_DATETIME:
+				{
+					time_t v=dbi_result_get_datetime_idx(d,pos);
+					if(f==binary_format) {
+						put_binary_number(o,static_cast<long long>(v));
+					}
+					else {
+						std::tm t;
+						utc_time(v,t);
+						o.commit(format_datetime(o.reserve(),t));
+					}
+				}
+				break;
+			case DBI_TYPE_BINARY:
+				{
+					size_t len=dbi_result_get_field_length_idx(d,pos);
+					unsigned char const *v=dbi_result_get_binary_idx(d,pos);
+					if(len==DBI_LENGTH_ERROR || !v)
+						len=0;
+					if(f==binary_format)
+						put_text(o,f,reinterpret_cast<char const *>(v),len);
+					else
+						put_hex(o,v,len,f==tsv_format);
+				}
+				break;
+			default:
+				{
+					char const *v=dbi_result_get_string_idx(d,pos);
+					size_t len=0;
+					if(v) {
+						len=dbi_result_get_field_length_idx(d,pos);
+						if(len==DBI_LENGTH_ERROR)
+							len=strlen(v);
+					}
+					put_text(o,f,v,len);
+				}
+			}
+		}
+		if(f!=binary_format)
+			o.put('\n');
+		rows++;
+	}
+	o.flush();
+	return rows;
+}
+
+} // dbixx
@@ -0,0 +1,98 @@
+#ifndef _DBIXX_EXPORT_H_
+#define _DBIXX_EXPORT_H_
+
+#include "dbixx.h"
+#include <sys/uio.h>
+#include <ostream>
+
+namespace dbixx {
+
+///
+/// \brief Format of exported and imported data
+///
+enum data_format {
+	///
+	/// Comma separated values according to RFC 4180. NULL is an empty field and an empty
+	/// string is written as "". Binary values are written in hexadecimal with "\x" prefix.
+	///
+	csv_format,
+	///
+	/// Tab separated values in PostgreSQL text format: NULL is written as \\N, and backslash,
+	/// tab, new line and carriage return are escaped as \\\\, \\t, \\n and \\r.
+	///
+	tsv_format,
+	///
+	/// Compact binary format. The header is the magic "DBIXXB1\n", 32 bit number of columns and
+	/// for each column its libdbi type as one byte, with the bit 0x80 set for unsigned integers,
+	/// and its name prefixed by 32 bit length. Each value is prefixed by 32 bit length, 0xFFFFFFFF
+	/// is NULL. Integers, date-times (as time_t) and decimals (as IEEE double) take 8 bytes,
+	/// strings and binary data are written as is. All numbers are little endian.
+	///
+	binary_format
+};
+
+///
+/// \brief Destination of exported data
+///
+class sink {
+public:
+	virtual ~sink() {}
+	///
+	/// Write \a n bytes from \a data, throw dbixx_error on failure
+	///
+	virtual void write(char const *data,size_t n) = 0;
+	///
+	/// Write \a n buffers described by \a v one after another. The default implementation
+	/// calls write() for each of them.
+	///
+	virtual void writev(iovec const *v,int n);
+};
+
+///
+/// \brief Sink that writes to a file descriptor, the descriptor is not closed
+///
+class fd_sink : public sink {
+public:
+	fd_sink(int fd) : fd_(fd) {}
+	virtual void write(char const *data,size_t n);
+	virtual void writev(iovec const *v,int n);
+private:
+	int fd_;
+};
+
+///
+/// \brief Sink that writes to a standard stream
+///
+class stream_sink : public sink {
+public:
+	stream_sink(std::ostream &out) : out_(out) {}
+	virtual void write(char const *data,size_t n);
+private:
+	std::ostream &out_;
+};
+
+///
+/// Write all remaining rows of \a res to \a out in format \a f, returns number of written rows.
+/// If \a header is true, the names of the columns are written first in text formats, binary format
+/// always starts with its header.
+///
+/// The values are formatted directly from the driver buffers into an output buffer of
+/// \a buffer_size bytes that is passed to the sink when it is full. Large strings and binary
+/// values that need no escaping are passed to the sink together with the buffer without copying.
+/// When used with session::fetch_stream() the memory does not depend on the size of the result.
+///
+/// \code
+///  dbixx::transaction tr(sql);
+///  dbixx::result res;
+///  sql<<"SELECT * FROM events";
+///  sql.fetch_stream(res);
+///  dbixx::fd_sink out(fd);
+///  dbixx::export_result(res,out,dbixx::csv_format);
+///  tr.commit();
+/// \endcode
+///
+unsigned long long export_result(result &res,sink &out,data_format f,bool header=true,size_t buffer_size=256*1024);
+
+} // dbixx
+
+#endif // _DBIXX_EXPORT_H_
@@ -0,0 +1,467 @@
+#include "import.h"
+#include "util.h"
+#include <deque>
+#include <vector>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace dbixx {
+
+namespace {
+
+	class mapped_file {
+		mapped_file(mapped_file const &);
+		mapped_file const &operator=(mapped_file const &);
+	public:
+		mapped_file(std::string const &path) : begin(NULL), end(NULL), size_(0)
+		{
+			int fd=open(path.c_str(),O_RDONLY);
+			if(fd < 0)
+				throw dbixx_error("Failed to open "+path+": "+strerror(errno));
+			struct stat st;
+			if(fstat(fd,&st) < 0) {
+				::close(fd);
+				throw dbixx_error("Failed to open "+path+": "+strerror(errno));
+			}
+			size_=st.st_size;
+			if(size_ > 0) {
+				void *p=mmap(NULL,size_,PROT_READ,MAP_PRIVATE,fd,0);
+				if(p==MAP_FAILED) {
+					::close(fd);
+					throw dbixx_error("Failed to map "+path+": "+strerror(errno));
+				}
+				madvise(p,size_,MADV_SEQUENTIAL);
+				begin=static_cast<char const *>(p);
+				end=begin+size_;
+			}
+			::close(fd);
+		}
+		~mapped_file()
+		{
+			if(begin)
+				munmap(const_cast<char *>(begin),size_);
+		}
+		char const *begin;
+		char const *end;
+	private:
+		size_t size_;
+	};
+
+	struct field {
+		char const *data;
+		size_t size;
+		bool null;
+		unsigned short type;
+	};
+
+	typedef std::deque<std::string> scratch_type;
+
+	//
+	// Parser of CSV and TSV formats, see export_result()
+	//
+	class text_parser {
+	public:
+		text_parser(char const *b,char const *e,data_format f) : p_(b), end_(e), csv_(f==csv_format) {}
+		bool next(std::vector<field> &row,scratch_type &scratch)
+		{
+			// Empty lines carry no data
+			while(p_ < end_ && (*p_=='\n' || (*p_=='\r' && p_+1 < end_ && p_[1]=='\n')))
+				p_ += *p_=='\r' ? 2 : 1;
+			if(p_ >= end_)
+				return false;
+			for(;;) {
+				field f;
+				f.type=DBI_TYPE_STRING;
+				f.null=false;
+				if(csv_)
+					csv_field(f,scratch);
+				else
+					tsv_field(f,scratch);
+				row.push_back(f);
+				if(p_ >= end_)
+					return true;
+				char c=*p_++;
+				if(c=='\n')
+					return true;
+				if(c=='\r' && p_ < end_ && *p_=='\n') {
+					p_++;
+					return true;
+				}
+			}
+		}
+	private:
+		void csv_field(field &f,scratch_type &scratch)
+		{
+			if(p_ < end_ && *p_=='"') {
+				char const *start=++p_;
+				std::string *unescaped=NULL;
+				for(;;) {
+					char const *q=static_cast<char const *>(memchr(p_,'"',end_-p_));
+					if(!q)
+						q=end_;
+					if(q+1 < end_ && q[1]=='"') {
+						// Doubled quote, the value has to be copied
+						if(!unescaped) {
+							scratch.push_back(std::string());
+							unescaped=&scratch.back();
+						}
+						unescaped->append(start,q+1);
+						p_=start=q+2;
+						continue;
+					}
+					if(unescaped) {
+						unescaped->append(start,q);
+						f.data=unescaped->c_str();
+						f.size=unescaped->size();
+					}
+					else {
+						f.data=start;
+						f.size=q-start;
+					}
+					p_ = q < end_ ? q+1 : end_;
+					break;
+				}
+				// Ignore anything between closing quote and separator
+				while(p_ < end_ && *p_!=',' && *p_!='\n' && *p_!='\r')
+					p_++;
+				return;
+			}
+			char const *start=p_;
+			while(p_ < end_ && *p_!=',' && *p_!='\n' && *p_!='\r')
+				p_++;
+			f.data=start;
+			f.size=p_-start;
+			f.null = f.size==0;
+		}
+		void tsv_field(field &f,scratch_type &scratch)
+		{
+			char const *start=p_;
+			bool escaped=false;
+			while(p_ < end_ && *p_!='\t' && *p_!='\n') {
+				if(*p_=='\\') {
+					escaped=true;
+					if(p_+1 < end_)
+						p_++;
+				}
+				p_++;
+			}
+			char const *stop=p_;
+			if(stop > start && stop[-1]=='\r' && (stop==end_ || *stop=='\n'))
+				stop--;
+			if(stop-start==2 && start[0]=='\\' && start[1]=='N') {
+				f.null=true;
+				f.data=start;
+				f.size=0;
+				return;
+			}
+			if(!escaped) {
+				f.data=start;
+				f.size=stop-start;
+				return;
+			}
+			scratch.push_back(std::string());
+			std::string &s=scratch.back();
+			s.reserve(stop-start);
+			for(char const *q=start;q < stop;q++) {
+				if(*q!='\\' || q+1==stop) {
+					s+=*q;
+					continue;
+				}
+				switch(*++q) {
+				case 't': s+='\t'; break;
+				case 'n': s+='\n'; break;
+				case 'r': s+='\r'; break;
+				case 'b': s+='\b'; break;
+				case 'f': s+='\f'; break;
+				case 'v': s+='\v'; break;
+				default: s+=*q;
+				}
+			}
+			f.data=s.c_str();
+			f.size=s.size();
+		}
+
+		char const *p_;
+		char const *end_;
+		bool csv_;
+	};
+
+	//
+	// Parser of binary format, see export_result()
+	//
+	class binary_parser {
+	public:
+		binary_parser(char const *b,char const *e) : p_(b), end_(e) {}
+		void header(std::vector<std::string> &names,std::vector<unsigned short> &types)
+		{
+			if(end_-p_ < 8 || memcmp(p_,"DBIXXB1\n",8)!=0)
+				throw dbixx_error("Invalid binary data header");
+			p_+=8;
+			unsigned cols=get_u32();
+			for(unsigned i=0;i<cols;i++) {
+				need(1);
+				types.push_back(static_cast<unsigned char>(*p_++));
+				size_t len=get_u32();
+				need(len);
+				names.push_back(std::string(p_,len));
+				p_+=len;
+			}
+		}
+		bool next(std::vector<field> &row,std::vector<unsigned short> const &types)
+		{
+			if(p_ >= end_)
+				return false;
+			for(unsigned i=0;i<types.size();i++) {
+				field f;
+				f.type=types[i];
+				unsigned len=get_u32();
+				f.null = len==0xFFFFFFFFU;
+				f.data=p_;
+				f.size=0;
+				if(!f.null) {
+					need(len);
+					f.size=len;
+					p_+=len;
+				}
+				row.push_back(f);
+			}
+			return true;
+		}
+	private:
+		void need(size_t n)
+		{
+			if(size_t(end_-p_) < n)
+				throw dbixx_error("Truncated binary data");
+		}
+		unsigned get_u32()
+		{
+			need(4);
+			unsigned v=0;
+			for(int i=3;i>=0;i--)
+				v=(v << 8) | static_cast<unsigned char>(p_[i]);
+			p_+=4;
+			return v;
+		}
+
+		char const *p_;
+		char const *end_;
+	};
+
+	unsigned long long get_u64(char const *p)
+	{
+		unsigned long long v=0;
+		for(int i=7;i>=0;i--)
+			v=(v << 8) | static_cast<unsigned char>(p[i]);
+		return v;
+	}
+
+	template<typename Binder>
+	void bind_field(Binder &b,field const &f,std::string &tmp)
+	{
+		if(f.null) {
+			b.bind(null());
+			return;
+		}
+		unsigned short type=f.type & ~unsigned_type_flag;
+		switch(type) {
+		case DBI_TYPE_INTEGER:
+		case DBI_TYPE_DECIMAL:
+		case DBI_TYPE_DATETIME:
+			if(f.size!=8)
+				throw dbixx_error("Invalid size of numeric value");
+			break;
+		case DBI_TYPE_BINARY:
+			b.bind(blob(f.data,f.size));
+			return;
+		default:
+			tmp.assign(f.data,f.size);
+			b.bind(tmp);
+			return;
+		}
+		unsigned long long bits=get_u64(f.data);
+		if(f.type==(DBI_TYPE_INTEGER | unsigned_type_flag)) {
+			b.bind(bits);
+		}
+		else if(type==DBI_TYPE_INTEGER) {
+			b.bind(static_cast<long long>(bits));
+		}
+		else if(type==DBI_TYPE_DECIMAL) {
+			double v;
+			memcpy(&v,&bits,sizeof(v));
+			b.bind(v);
+		}
+		else {
+			time_t v=static_cast<time_t>(static_cast<long long>(bits));
+			std::tm t;
+			utc_time(v,t);
+			b.bind(t);
+		}
+	}
+
+	bool valid_name(std::string const &name)
+	{
+		if(name.empty())
+			return false;
+		for(unsigned i=0;i<name.size();i++) {
+			char c=name[i];
+			if(!(('a'<=c && c<='z') || ('A'<=c && c<='Z') || ('0'<=c && c<='9') || c=='_'))
+				return false;
+		}
+		return true;
+	}
+
+	bool valid_table(std::string const &name)
+	{
+		// Possibly qualified by schema
+		size_t dot=name.find('.');
+		if(dot==std::string::npos)
+			return valid_name(name);
+		return valid_name(name.substr(0,dot)) && valid_name(name.substr(dot+1));
+	}
+
+	class loader {
+	public:
+		loader(session &s,std::string const &table,std::vector<std::string> const &names,unsigned cols,
+			unsigned batch_rows,import_stats &st) :
+			sql_(s),
+			cols_(cols),
+			batch_rows_(batch_rows==0 ? 1 : batch_rows),
+			rows_(0),
+			stats_(st)
+		{
+			if(!valid_table(table))
+				throw dbixx_error("Invalid table name "+table);
+			prefix_="INSERT INTO "+table;
+			if(!names.empty()) {
+				prefix_+='(';
+				for(unsigned i=0;i<names.size();i++) {
+					if(!valid_name(names[i]))
+						throw dbixx_error("Invalid column name "+names[i]);
+					if(i > 0)
+						prefix_+=',';
+					prefix_+=names[i];
+				}
+				prefix_+=')';
+			}
+			prefix_+=" VALUES";
+			row_template_="(";
+			for(unsigned i=0;i<cols;i++)
+				row_template_+= i==0 ? "?" : ",?";
+			row_template_+=')';
+			single_=prefix_+" "+row_template_;
+		}
+		std::vector<field> &fields() { return fields_; }
+		scratch_type &scratch() { return scratch_; }
+		void row_done()
+		{
+			if(fields_.size()!=(rows_+1)*cols_) {
+				fields_.resize(rows_*cols_);
+				stats_.rejected++;
+				return;
+			}
+			rows_++;
+			if(rows_ >= batch_rows_)
+				flush();
+		}
+		void flush()
+		{
+			if(rows_==0)
+				return;
+			try {
+				transaction step(sql_);
+				bulk_insert ins(sql_,prefix_,row_template_,rows_,size_t(-1));
+				for(size_t i=0;i<fields_.size();i++)
+					bind_field(ins,fields_[i],tmp_);
+				ins.flush();
+				step.commit();
+				stats_.rows+=rows_;
+			}
+			catch(dbixx_error const &) {
+				// Find the rows the database refuses
+				for(unsigned r=0;r<rows_;r++) {
+					try {
+						transaction one(sql_);
+						sql_.query(single_);
+						for(unsigned i=0;i<cols_;i++)
+							bind_field(sql_,fields_[r*cols_+i],tmp_);
+						sql_.exec();
+						one.commit();
+						stats_.rows++;
+					}
+					catch(dbixx_error const &) {
+						stats_.rejected++;
+					}
+				}
+			}
+			fields_.clear();
+			scratch_.clear();
+			rows_=0;
+		}
+	private:
+		session &sql_;
+		std::string prefix_;
+		std::string row_template_;
+		std::string single_;
+		unsigned cols_;
+		unsigned batch_rows_;
+		unsigned rows_;
+		std::vector<field> fields_;
+		scratch_type scratch_;
+		std::string tmp_;
+		import_stats &stats_;
+	};
+}
+
+import_stats import_file(session &sql,std::string const &path,std::string const &table,data_format f,
+			bool header,unsigned batch_rows)
+{
+	import_stats stats;
+	double start=now();
+	mapped_file file(path);
+	transaction all(sql);
+	if(f==binary_format) {
+		binary_parser parser(file.begin,file.end);
+		std::vector<std::string> names;
+		std::vector<unsigned short> types;
+		parser.header(names,types);
+		loader load(sql,table,names,types.size(),batch_rows,stats);
+		while(parser.next(load.fields(),types))
+			load.row_done();
+		load.flush();
+	}
+	else {
+		text_parser parser(file.begin,file.end,f);
+		std::vector<std::string> names;
+		std::vector<field> first;
+		scratch_type first_scratch;
+		if(!parser.next(first,first_scratch)) {
+			all.commit();
+			stats.seconds=now()-start;
+			return stats;
+		}
+		if(header) {
+			for(unsigned i=0;i<first.size();i++)
+				names.push_back(std::string(first[i].data,first[i].size));
+			first.clear();
+		}
+		unsigned cols = header ? names.size() : first.size();
+		loader load(sql,table,names,cols,batch_rows,stats);
+		if(!header) {
+			load.fields()=first;
+			load.scratch().swap(first_scratch);
+			load.row_done();
+		}
+		while(parser.next(load.fields(),load.scratch()))
+			load.row_done();
+		load.flush();
+	}
+	all.commit();
+	stats.seconds=now()-start;
+	return stats;
+}
+
+} // dbixx
@@ -0,0 +1,59 @@
+#ifndef _DBIXX_IMPORT_H_
+#define _DBIXX_IMPORT_H_
+
+#include "dbixx.h"
+#include "export.h"
+
+namespace dbixx {
+
+///
+/// \brief Results of import_file()
+///
+struct import_stats {
+	import_stats() : rows(0), rejected(0), seconds(0) {}
+	///
+	/// Number of inserted rows
+	///
+	unsigned long long rows;
+	///
+	/// Number of rows that were malformed or refused by the database
+	///
+	unsigned long long rejected;
+	///
+	/// Total time of the import in seconds
+	///
+	double seconds;
+	///
+	/// Get the import rate
+	///
+	double rows_per_second() const { return seconds > 0 ? rows / seconds : 0; }
+};
+
+///
+/// Load file \a path written in format \a f, see export_result(), into table \a table using
+/// session \a sql, and return the number of inserted and rejected rows.
+///
+/// The file is mapped into memory and parsed in place. If \a header is true the first
+/// line of text formats holds the names of the columns, otherwise the values are inserted
+/// to the columns of the table in their order. Binary format always carries the names of the columns.
+///
+/// The rows are inserted in batches of \a batch_rows rows using bulk_insert, inside a single
+/// transaction (or a savepoint if a transaction is already active). Each batch runs in its own
+/// savepoint; if the database refuses it, its rows are inserted one by one and the rows that
+/// fail are counted as rejected. Text rows with wrong number of values are rejected as well.
+///
+/// The names of the table and the columns are written into the statement as is, so they may
+/// consist only of letters, digits and underscores; the table name may be qualified by schema.
+///
+/// \code
+///  dbixx::import_stats st=dbixx::import_file(sql,"users.csv","users",dbixx::csv_format);
+///  std::cout << st.rows << " rows, " << st.rejected << " rejected, "
+///            << st.rows_per_second() << " rows/s" << std::endl;
+/// \endcode
+///
+import_stats import_file(session &sql,std::string const &path,std::string const &table,data_format f,
+			bool header=true,unsigned batch_rows=500);
+
+} // dbixx
+
+#endif // _DBIXX_IMPORT_H_
@@ -0,0 +1,67 @@
+#ifndef _DBIXX_MUTEX_H_
+#define _DBIXX_MUTEX_H_
+
+#include <pthread.h>
+#include <ctime>
+
+namespace dbixx {
+
+///
+/// \brief Thin wrapper over pthread mutex used by thread safe dbixx objects
+///
+class mutex {
+	// non copyable
+	mutex(mutex const &);
+	mutex const &operator=(mutex const &);
+public:
+	mutex() { pthread_mutex_init(&m_,NULL); }
+	~mutex() { pthread_mutex_destroy(&m_); }
+	void lock() { pthread_mutex_lock(&m_); }
+	void unlock() { pthread_mutex_unlock(&m_); }
+	///
+	/// \brief Scoped lock guard: locks the mutex in constructor and unlocks it in destructor
+	///
+	class guard {
+		guard(guard const &);
+		guard const &operator=(guard const &);
+	public:
+		guard(mutex &m) : m_(m) { m_.lock(); }
+		~guard() { m_.unlock(); }
+	private:
+		mutex &m_;
+	};
+private:
+	pthread_mutex_t m_;
+	friend class condition;
+};
+
+///
+/// \brief Thin wrapper over pthread condition variable
+///
+class condition {
+	// non copyable
+	condition(condition const &);
+	condition const &operator=(condition const &);
+public:
+	condition() { pthread_cond_init(&c_,NULL); }
+	~condition() { pthread_cond_destroy(&c_); }
+	///
+	/// Wait for notification, \a m should be locked
+	///
+	void wait(mutex &m) { pthread_cond_wait(&c_,&m.m_); }
+	///
+	/// Wait for notification at most till absolute time \a deadline, returns false on timeout
+	///
+	bool wait_until(mutex &m,timespec const &deadline)
+	{
+		return pthread_cond_timedwait(&c_,&m.m_,&deadline)==0;
+	}
+	void notify_one() { pthread_cond_signal(&c_); }
+	void notify_all() { pthread_cond_broadcast(&c_); }
+private:
+	pthread_cond_t c_;
+};
+
+} // dbixx
+
+#endif // _DBIXX_MUTEX_H_
@@ -0,0 +1,150 @@
+#include "parallel.h"
+#include "mutex.h"
+
+namespace dbixx {
+
+struct parallel_job::state {
+	state(parallel_job &j,pool &pl,std::string const &q,unsigned t,bool o) :
+		job(j),
+		connections(pl),
+		query(q),
+		size(j.size()),
+		threads(t),
+		ordered(o),
+		next(0),
+		failed(false),
+		next_delivery(0)
+	{
+		if(ordered) {
+			ready.resize(size);
+			done.resize(size,false);
+		}
+	}
+	parallel_job &job;
+	pool &connections;
+	std::string const &query;
+	size_t size;
+	unsigned threads;
+	bool ordered;
+
+	mutex lock;
+	size_t next;
+	bool failed;
+	std::string error;
+	std::string error_query;
+
+	mutex delivery_lock;
+	size_t next_delivery;
+	std::vector<table> ready;
+	std::vector<bool> done;
+
+	void fail(std::string const &e,std::string const &q)
+	{
+		mutex::guard g(lock);
+		if(failed)
+			return;
+		failed=true;
+		error=e;
+		error_query=q;
+	}
+	bool stopped()
+	{
+		mutex::guard g(lock);
+		return failed;
+	}
+	bool take(size_t &begin,size_t &end)
+	{
+		mutex::guard g(lock);
+		if(failed || next >= size)
+			return false;
+		// Large chunks first, smaller ones as the work runs out, so threads finish together
+		size_t chunk=(size - next) / (threads * 4);
+		if(chunk==0)
+			chunk=1;
+		begin=next;
+		end=next+=chunk;
+		return true;
+	}
+};
+
+void parallel_job::run(pool &p,std::string const &query,unsigned threads,bool ordered)
+{
+	size_t n=size();
+	if(n==0)
+		return;
+	if(threads==0)
+		threads=1;
+	if(threads > n)
+		threads=n;
+	state s(*this,p,query,threads,ordered);
+	std::vector<pthread_t> ids;
+	ids.reserve(threads);
+	for(unsigned i=0;i<threads;i++) {
+		pthread_t tid;
+		if(pthread_create(&tid,NULL,&parallel_job::thread_main,&s)!=0) {
+			s.fail("Failed to create worker thread","");
+			break;
+		}
+		ids.push_back(tid);
+	}
+	for(unsigned i=0;i<ids.size();i++)
+		pthread_join(ids[i],NULL);
+	if(s.failed)
+		throw dbixx_error(s.error,s.error_query);
+}
+
+void *parallel_job::thread_main(void *s)
+{
+	work(*static_cast<state *>(s));
+	return NULL;
+}
+
+void parallel_job::work(state &s)
+{
+	try {
+		pooled_session sql(s.connections);
+		table rows;
+		size_t begin,end;
+		while(s.take(begin,end)) {
+			for(size_t i=begin;i<end && !s.stopped();i++) {
+				sql->query(s.query);
+				s.job.bind(*sql,i);
+				sql->fetch(rows);
+				deliver(s,i,rows);
+			}
+		}
+	}
+	catch(dbixx_error const &e) {
+		s.fail(e.what(),e.query());
+	}
+	catch(std::exception const &e) {
+		s.fail(e.what(),"");
+	}
+	catch(...) {
+		s.fail("Unknown error in parallel query","");
+	}
+}
+
+void parallel_job::deliver(state &s,size_t i,table &rows)
+{
+	mutex::guard g(s.delivery_lock);
+	if(!s.ordered) {
+		s.job.deliver(i,rows);
+		return;
+	}
+	if(i!=s.next_delivery) {
+		s.ready[i].swap(rows);
+		s.done[i]=true;
+		return;
+	}
+	s.job.deliver(i,rows);
+	s.next_delivery++;
+	while(s.next_delivery < s.size && s.done[s.next_delivery]) {
+		table &t=s.ready[s.next_delivery];
+		s.job.deliver(s.next_delivery,t);
+		table().swap(t);
+		s.next_delivery++;
+	}
+}
+
+} // dbixx
@@ -0,0 +1,90 @@
+#ifndef _DBIXX_PARALLEL_H_
+#define _DBIXX_PARALLEL_H_
+
+#include "dbixx.h"
+#include "pool.h"
+#include "table.h"
+#include <vector>
+
+namespace dbixx {
+
+///
+/// \brief Type independent part of parallel_for_each(), it is not used directly
+///
+class parallel_job {
+public:
+	virtual ~parallel_job() {}
+	///
+	/// Get number of keys
+	///
+	virtual size_t size() = 0;
+	///
+	/// Bind the key \a i to the query of \a sql
+	///
+	virtual void bind(session &sql,size_t i) = 0;
+	///
+	/// Pass the result \a rows of the key \a i to the callback
+	///
+	virtual void deliver(size_t i,table const &rows) = 0;
+	///
+	/// Execute \a query for all keys using \a threads threads with sessions from pool \a p
+	///
+	void run(pool &p,std::string const &query,unsigned threads,bool ordered);
+private:
+	struct state;
+	static void *thread_main(void *s);
+	static void work(state &s);
+	static void deliver(state &s,size_t i,table &rows);
+};
+
+///
+/// \brief Implementation of parallel_job for a vector of keys and a callback
+///
+template<typename Key,typename Callback>
+class parallel_keys_job : public parallel_job {
+public:
+	parallel_keys_job(std::vector<Key> const &keys,Callback &callback) : keys_(keys), callback_(callback) {}
+	virtual size_t size() { return keys_.size(); }
+	virtual void bind(session &sql,size_t i) { sql.bind(keys_[i]); }
+	virtual void deliver(size_t i,table const &rows) { callback_(keys_[i],rows); }
+private:
+	std::vector<Key> const &keys_;
+	Callback &callback_;
+};
+
+///
+/// Execute \a query that has a single parameter for each of \a keys, using \a threads worker threads
+/// that take their sessions from pool \a p, and pass each key with its result to \a callback
+/// as callback(key,rows), where rows is a table.
+///
+/// The keys are handed to the threads in chunks that shrink as the work runs out, so fast threads
+/// take more of the work. The callback is never called concurrently, so it does not have to
+/// be thread safe. If \a ordered is true it is called in the order of the keys, holding the
+/// results that are ready early in memory, otherwise it is called as soon as the result of
+/// a key is ready.
+///
+/// The first error stops the processing of other keys and is thrown as dbixx_error once all
+/// threads are finished.
+///
+/// \code
+///  struct collect {
+///      std::map<int,std::string> names;
+///      void operator()(int id,dbixx::table const &t) {
+///          if(t.rows()) names[id]=t.get<std::string>(0,1);
+///      }
+///  };
+///  collect c;
+///  dbixx::parallel_for_each(connections,ids,"SELECT name FROM users WHERE id=?",c,8);
+/// \endcode
+///
+template<typename Key,typename Callback>
+void parallel_for_each(pool &p,std::vector<Key> const &keys,std::string const &query,Callback &callback,
+			unsigned threads=4,bool ordered=true)
+{
+	parallel_keys_job<Key,Callback> job(keys,callback);
+	job.run(p,query,threads,ordered);
+}
+
+} // dbixx
+
+#endif // _DBIXX_PARALLEL_H_
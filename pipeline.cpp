@@ -0,0 +1,151 @@
+#include "dbixx.h"
+#include "async.h"
+
+namespace dbixx {
+
+pipeline::pipeline(session &s) : sql(s)
+{
+}
+
+void pipeline::query(std::string const &q)
+{
+	// Statements are executed as plain text, possibly on other connections,
+	// so they can't refer to server side prepared statements
+	bool prepare=sql.use_server_prepare;
+	sql.use_server_prepare=false;
+	try {
+		sql.query(q);
+	}
+	catch(...) {
+		sql.use_server_prepare=prepare;
+		throw;
+	}
+	sql.use_server_prepare=prepare;
+}
+
+void pipeline::push(result *r,table *t)
+{
+	if(!sql.state.complete)
+		throw dbixx_error("Not all parameters are bind");
+	entries.push_back(entry());
+	entries.back().query=sql.state.text();
+	entries.back().text=sql.state.escaped_query;
+	entries.back().res=r;
+	entries.back().tab=t;
+	entries.back().affected=0;
+}
+
+void pipeline::add(result &r)
+{
+	push(&r,NULL);
+}
+
+void pipeline::add(table &t)
+{
+	push(NULL,&t);
+}
+
+void pipeline::add()
+{
+	push(NULL,NULL);
+}
+
+unsigned long long pipeline::affected(unsigned i)
+{
+	if(i >= entries.size())
+		throw dbixx_error("Invalid statement index");
+	return entries[i].affected;
+}
+
+void pipeline::execute(session &s,entry &e)
+{
+	dbi_result res=s.raw_query(e.text,e.query);
+	if(e.res) {
+		e.res->assign(res,&s);
+		return;
+	}
+	if(e.tab) {
+		// Copy the rows while the connection is owned by this thread
+		result r;
+		r.assign(res,&s);
+		r.materialize(*e.tab);
+		return;
+	}
+	if(dbi_result_get_numrows(res)!=0) {
+		s.release(res);
+		throw dbixx_error("exec() query may not return results",e.text);
+	}
+	e.affected=dbi_result_get_numrows_affected(res);
+	s.release(res);
+}
+
+void pipeline::invalidate()
+{
+	// Like session::exec(), writes drop the cached results of the tables they change,
+	// failed statements are included as some of them could be already applied
+	if(!sql.results_cache)
+		return;
+	for(unsigned i=0;i<entries.size();i++) {
+		if(!entries[i].res && !entries[i].tab)
+			sql.invalidate_cached(entries[i].query);
+	}
+}
+
+void pipeline::run()
+{
+	try {
+		for(unsigned i=0;i<entries.size();i++)
+			execute(sql,entries[i]);
+	}
+	catch(...) {
+		invalidate();
+		throw;
+	}
+	invalidate();
+}
+
+class pipeline_task : public task {
+public:
+	pipeline_task(pipeline::entry &e) : e_(e) {}
+	virtual void run(session &sql)
+	{
+		pipeline::execute(sql,e_);
+	}
+private:
+	pipeline::entry &e_;
+};
+
+void pipeline::run(async_session &a)
+{
+	std::vector<pipeline_task> tasks;
+	tasks.reserve(entries.size());
+	std::vector<future> done;
+	done.reserve(entries.size());
+	try {
+		for(unsigned i=0;i<entries.size();i++) {
+			if(entries[i].res)
+				continue;
+			tasks.push_back(pipeline_task(entries[i]));
+			done.push_back(a.submit(tasks.back()));
+		}
+		// The pooled session may be closed once it is returned to the pool, so
+		// the results that keep the connection come from the pipeline's session
+		for(unsigned i=0;i<entries.size();i++) {
+			if(entries[i].res)
+				execute(sql,entries[i]);
+		}
+	}
+	catch(...) {
+		for(unsigned i=0;i<done.size();i++)
+			done[i].wait();
+		invalidate();
+		throw;
+	}
+	for(unsigned i=0;i<done.size();i++)
+		done[i].wait();
+	invalidate();
+	for(unsigned i=0;i<done.size();i++)
+		done[i].get();
+}
+
+} // dbixx
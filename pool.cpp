@@ -0,0 +1,132 @@
+#include "pool.h"
+
+namespace dbixx {
+
+pool::pool(std::string const &connection_string,unsigned max_size,unsigned max_idle) :
+	conn_str_(connection_string),
+	max_size_(max_size),
+	max_idle_(max_idle),
+	validate_after_(30),
+	total_(0)
+{
+	if(max_size_==0)
+		throw dbixx_error("Pool size must be positive");
+	if(max_idle_ > max_size_)
+		max_idle_=max_size_;
+}
+
+pool::~pool()
+{
+	clear();
+}
+
+void pool::validate_after(int seconds)
+{
+	mutex::guard g(lock_);
+	validate_after_=seconds;
+}
+
+unsigned pool::size()
+{
+	mutex::guard g(lock_);
+	return total_;
+}
+
+unsigned pool::idle()
+{
+	mutex::guard g(lock_);
+	return idle_.size();
+}
+
+void pool::clear()
+{
+	std::list<entry> tmp;
+	{
+		mutex::guard g(lock_);
+		tmp.swap(idle_);
+		total_-=tmp.size();
+		cond_.notify_all();
+	}
+	for(std::list<entry>::iterator p=tmp.begin();p!=tmp.end();++p)
+		delete p->sql;
+}
+
+void pool::validate(entry &e)
+{
+	if(time(NULL) - e.last_used < validate_after_)
+		return;
+	// Not ping(), it may reset the connection without the session knowing that its
+	// prepared statements are gone, reconnect() starts a new connection generation
+	if(!e.sql->alive())
+		e.sql->reconnect();
+}
+
+session *pool::checkout()
+{
+	entry e;
+	e.sql=NULL;
+	{
+		mutex::guard g(lock_);
+		while(idle_.empty() && total_ >= max_size_)
+			cond_.wait(lock_);
+		if(idle_.empty()) {
+			total_++;
+		}
+		else {
+			// Most recently used session is the warmest one
+			e=idle_.front();
+			idle_.pop_front();
+		}
+	}
+	// Connecting and validation are slow, don't hold the lock for them
+	try {
+		if(e.sql)
+			validate(e);
+		else
+			e.sql=new session(conn_str_);
+	}
+	catch(...) {
+		delete e.sql;
+		mutex::guard g(lock_);
+		total_--;
+		cond_.notify_one();
+		throw;
+	}
+	return e.sql;
+}
+
+void pool::checkin(session *s,bool broken)
+{
+	// Don't pass the settings of one user to the next one
+	if(!broken && !s->recycle())
+		broken=true;
+	{
+		mutex::guard g(lock_);
+		if(!broken && idle_.size() < max_idle_) {
+			entry e;
+			e.sql=s;
+			e.last_used=time(NULL);
+			idle_.push_front(e);
+			s=NULL;
+		}
+		else {
+			total_--;
+		}
+		cond_.notify_one();
+	}
+	delete s;
+}
+
+pooled_session::pooled_session(pool &p) :
+	pool_(p),
+	sql_(p.checkout()),
+	broken_(false)
+{
+}
+
+pooled_session::~pooled_session()
+{
+	pool_.checkin(sql_,broken_);
+}
+
+} // dbixx
@@ -0,0 +1,135 @@
+#ifndef _DBIXX_POOL_H_
+#define _DBIXX_POOL_H_
+
+#include "dbixx.h"
+#include "mutex.h"
+#include <list>
+#include <string>
+
+namespace dbixx {
+
+///
+/// \brief Thread safe pool of connected sessions that share the same connection string
+///
+/// The pool keeps a bounded set of warm connections so the cost of loading the driver
+/// and connecting is paid only once per connection rather then once per request.
+/// Sessions are taken from the pool using pooled_session object that returns
+/// the session back when it is destroyed.
+///
+/// \code
+///  dbixx::pool connections("sqlite3:dbname=test.db;sqlite3_dbdir=./");
+///  ...
+///  dbixx::pooled_session sql(connections);
+///  sql->query("SELECT name FROM users WHERE id=?");
+///  ...
+/// \endcode
+///
+class pool {
+	// non copyable
+	pool(pool const &);
+	pool const &operator=(pool const &);
+public:
+	///
+	/// Create a pool of connections for \a connection_string, see session::connect(std::string const &)
+	/// for its format.
+	///
+	/// No more then \a max_size sessions are open at same time, if all of them are in use
+	/// the caller waits till some session is returned. At most \a max_idle unused sessions are kept
+	/// open, others are closed when returned to the pool.
+	///
+	pool(std::string const &connection_string,unsigned max_size=16,unsigned max_idle=4);
+	///
+	/// Close all idle sessions, all sessions should be returned to the pool before it is destroyed
+	///
+	~pool();
+	///
+	/// Get the connection string this pool uses
+	///
+	std::string const &connection_string() const { return conn_str_; }
+	///
+	/// Set the time in seconds a session may stay idle before it is checked with a trivial query
+	/// when it is taken from the pool, default is 30 seconds. Zero means check always. A session
+	/// that fails the check is reconnected.
+	///
+	void validate_after(int seconds);
+	///
+	/// Get number of open sessions, including ones that are in use
+	///
+	unsigned size();
+	///
+	/// Get number of idle sessions
+	///
+	unsigned idle();
+	///
+	/// Close all idle sessions
+	///
+	void clear();
+private:
+	struct entry {
+		session *sql;
+		time_t last_used;
+	};
+
+	session *checkout();
+	void checkin(session *s,bool broken);
+	void validate(entry &e);
+
+	std::string conn_str_;
+	unsigned max_size_;
+	unsigned max_idle_;
+	int validate_after_;
+	unsigned total_;
+	std::list<entry> idle_;
+	mutex lock_;
+	condition cond_;
+
+	friend class pooled_session;
+};
+
+///
+/// \brief Scoped session taken from pool. The session is returned to the pool
+/// in destructor.
+///
+/// When the session is returned, its server side prepare flag, observer, cache, replicas
+/// and retry policy are reset to the defaults. The results and rows fetched from the session
+/// must be destroyed before it is returned; a session that still has some of them or an open
+/// transaction is closed rather then returned to the pool.
+///
+class pooled_session {
+	// non copyable
+	pooled_session(pooled_session const &);
+	pooled_session const &operator=(pooled_session const &);
+public:
+	///
+	/// Take a session from pool \a p, waits if all sessions are in use
+	///
+	pooled_session(pool &p);
+	///
+	/// Return the session to the pool
+	///
+	~pooled_session();
+	///
+	/// Get the session
+	///
+	session &get() { return *sql_; }
+	///
+	/// Get the session
+	///
+	session &operator*() { return *sql_; }
+	///
+	/// Get the session
+	///
+	session *operator->() { return sql_; }
+	///
+	/// Mark the session as broken, it would be closed rather then returned to the pool
+	///
+	void invalidate() { broken_=true; }
+private:
+	pool &pool_;
+	session *sql_;
+	bool broken_;
+};
+
+} // dbixx
+
+#endif // _DBIXX_POOL_H_
@@ -0,0 +1,83 @@
+#include "replicas.h"
+
+namespace dbixx {
+
+replica_set::replica_set(int eject_for) :
+	eject_for_(eject_for),
+	next_(0),
+	failures_(0)
+{
+}
+
+void replica_set::add(std::string const &connection_string)
+{
+	replica r;
+	r.conn_str=connection_string;
+	r.outstanding=0;
+	r.ejected_until=0;
+	mutex::guard g(lock_);
+	replicas_.push_back(r);
+}
+
+unsigned replica_set::size()
+{
+	mutex::guard g(lock_);
+	return replicas_.size();
+}
+
+unsigned replica_set::healthy()
+{
+	time_t now=time(NULL);
+	mutex::guard g(lock_);
+	unsigned n=0;
+	for(unsigned i=0;i<replicas_.size();i++)
+		if(replicas_[i].ejected_until <= now)
+			n++;
+	return n;
+}
+
+unsigned long long replica_set::failures()
+{
+	mutex::guard g(lock_);
+	return failures_;
+}
+
+int replica_set::acquire()
+{
+	time_t now=time(NULL);
+	mutex::guard g(lock_);
+	unsigned n=replicas_.size();
+	int best=-1;
+	for(unsigned i=0;i<n;i++) {
+		unsigned id=(next_ + i) % n;
+		replica const &r=replicas_[id];
+		if(r.ejected_until > now)
+			continue;
+		if(best==-1 || r.outstanding < replicas_[best].outstanding)
+			best=id;
+	}
+	if(best!=-1) {
+		replicas_[best].outstanding++;
+		next_=best+1;
+	}
+	return best;
+}
+
+void replica_set::release(int id,bool failed)
+{
+	mutex::guard g(lock_);
+	replica &r=replicas_[id];
+	r.outstanding--;
+	if(failed) {
+		r.ejected_until=time(NULL)+eject_for_;
+		failures_++;
+	}
+}
+
+std::string replica_set::connection_string(int id)
+{
+	mutex::guard g(lock_);
+	return replicas_[id].conn_str;
+}
+
+} // dbixx
@@ -0,0 +1,74 @@
+#ifndef _DBIXX_REPLICAS_H_
+#define _DBIXX_REPLICAS_H_
+
+#include "dbixx.h"
+#include "mutex.h"
+#include <vector>
+#include <string>
+
+namespace dbixx {
+
+///
+/// \brief Thread safe set of read replicas shared by sessions, see session::replicas()
+///
+/// Each read is sent to the healthy replica with the least number of queries currently
+/// executed by all sessions that use the set, ties are broken in round robin order.
+/// A replica whose connection fails is ejected for a period of time and the read is
+/// retried on another one. If no replica is available the read goes to the primary.
+///
+/// \code
+///  dbixx::replica_set replicas;
+///  replicas.add("pgsql:host=replica1;dbname=app");
+///  replicas.add("pgsql:host=replica2;dbname=app");
+///  dbixx::session sql("pgsql:host=primary;dbname=app");
+///  sql.replicas(&replicas);
+/// \endcode
+///
+class replica_set {
+	// non copyable
+	replica_set(replica_set const &);
+	replica_set const &operator=(replica_set const &);
+public:
+	///
+	/// Create an empty set, failed replicas are ejected for \a eject_for seconds
+	///
+	replica_set(int eject_for=30);
+	///
+	/// Add a replica with connection string \a connection_string, see session::connect(std::string const &)
+	///
+	void add(std::string const &connection_string);
+	///
+	/// Get number of replicas
+	///
+	unsigned size();
+	///
+	/// Get number of replicas that are not ejected
+	///
+	unsigned healthy();
+	///
+	/// Get number of queries that failed because of the connection to a replica
+	///
+	unsigned long long failures();
+private:
+	struct replica {
+		std::string conn_str;
+		unsigned outstanding;
+		time_t ejected_until;
+	};
+
+	int acquire();
+	void release(int id,bool failed);
+	std::string connection_string(int id);
+
+	std::vector<replica> replicas_;
+	int eject_for_;
+	unsigned next_;
+	unsigned long long failures_;
+	mutex lock_;
+
+	friend class session;
+};
+
+} // dbixx
+
+#endif // _DBIXX_REPLICAS_H_
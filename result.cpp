@@ -1,40 +1,191 @@
 #include "dbixx.h"
+#include <stdio.h>
 
 namespace dbixx {
 using namespace std;
 
 result::~result()
 {
+	unbind();
+	clear_members();
+	try {
+		close_stream();
+	}
+	catch(...) {}
 	if(res)
-		dbi_result_free(res);
+		row::release(res,source);
 }
 
 unsigned long long result::rows()
 {
+	if(stream_owner)
+		throw dbixx_error("Number of rows is not known for streaming result");
 	if(res)
 		return dbi_result_get_numrows(res);
 	throw dbixx_error("No result assigned");
 }
 
-void result::assign(dbi_result r)
+void result::assign(dbi_result r,session *s)
 {
+	close_stream();
+	stream_owner=NULL;
 	if(res && r!=res)
-		dbi_result_free(res);
+		row::release(res,source);
 	res=r;
+	source=s;
+	if(res && source)
+		source->attach();
+	outputs_ready=false;
+	members_ready=false;
+	info.clear();
+	if(res)
+		info.load(res);
+}
+
+void result::unbind()
+{
+	for(unsigned i=0;i<outputs.size();i++)
+		delete outputs[i];
+	outputs.clear();
+	outputs_ready=false;
+}
+
+void result::clear_members()
+{
+	for(unsigned i=0;i<members.size();i++)
+		delete members[i];
+	members.clear();
+	mapped_key=NULL;
+	members_ready=false;
+}
+
+bool result::fetch_members(char *base)
+{
+	if(!next(bound_row))
+		return false;
+	if(!members_ready) {
+		if(members.size() > info.size())
+			throw dbixx_error("More fields mapped then columns returned by query");
+		for(unsigned i=0;i<members.size();i++)
+			members[i]->resolve(info,i+1);
+		members_ready=true;
+	}
+	for(unsigned i=0;i<members.size();i++)
+		members[i]->fetch(bound_row,i+1,base);
+	return true;
+}
+
+bool result::next()
+{
+	if(outputs.empty())
+		throw dbixx_error("No variables bound to the result");
+	if(!next(bound_row))
+		return false;
+	if(!outputs_ready) {
+		if(outputs.size() > info.size())
+			throw dbixx_error("More variables bound then columns returned by query");
+		for(unsigned i=0;i<outputs.size();i++)
+			outputs[i]->resolve(info,i+1);
+		outputs_ready=true;
+	}
+	for(unsigned i=0;i<outputs.size();i++)
+		outputs[i]->fetch(bound_row,i+1);
+	return true;
+}
+
+void schema::clear()
+{
+	columns.clear();
+	by_name.clear();
+}
+
+void schema::load(dbi_result r)
+{
+	clear();
+	unsigned n=dbi_result_get_numfields(r);
+	if(n==DBI_FIELD_ERROR)
+		throw dbixx_error("Failed to fetch number of columns");
+	columns.resize(n);
+	for(unsigned i=0;i<n;i++) {
+		column &c=columns[i];
+		c.type=dbi_result_get_field_type_idx(r,i+1);
+		c.attribs=dbi_result_get_field_attribs_idx(r,i+1);
+		char const *name=dbi_result_get_field_name(r,i+1);
+		if(name) {
+			c.name=name;
+			by_name.insert(std::make_pair(c.name,i+1));
+		}
+	}
+}
+
+void result::start_stream(session *s,std::string const &name,unsigned batch)
+{
+	stream_owner=s;
+	source=s;
+	cursor=name;
+	stream_batch=batch;
+	stream_end=false;
+	fetch_more();
+}
+
+void result::close_stream()
+{
+	if(stream_end)
+		return;
+	stream_end=true;
+	stream_owner->release(stream_owner->raw_query("CLOSE "+cursor,"CLOSE ?"));
+}
+
+bool result::fetch_more()
+{
+	if(stream_end)
+		return false;
+	if(res) {
+		row::release(res,source);
+		res=NULL;
+	}
+	char buf[64];
+	snprintf(buf,sizeof(buf),"FETCH FORWARD %u FROM ",stream_batch);
+	res=stream_owner->raw_query(buf+cursor,"FETCH FORWARD ? FROM ?");
+	stream_owner->attach();
+	if(info.size()==0)
+		info.load(res);
+	unsigned long long n=dbi_result_get_numrows(res);
+	if(n < stream_batch)
+		close_stream();
+	return n > 0;
 }
 
 bool result::next(row &r)
 {
 	if(!res)
 		throw dbixx_error("No result assigned");
-	if(dbi_result_next_row(res)) {
-		r.set(res);
-		return true;
+	while(!dbi_result_next_row(res)) {
+		if(!fetch_more()) {
+			r.reset();
+			return false;
+		}
 	}
-	else {
-		r.reset();
-		return false;
+	r.set(res,&info);
+	return true;
+}
+
+size_t result::fetch_batch(size_t n,batch &b)
+{
+	if(!res)
+		throw dbixx_error("No result assigned");
+	if(b.columns.size() > info.size())
+		throw dbixx_error("More columns bound then returned by query");
+	for(unsigned i=0;i<b.columns.size();i++)
+		b.columns[i]->start(info,i+1,n);
+	row r;
+	size_t count=0;
+	while(count < n && next(r)) {
+		for(unsigned i=0;i<b.columns.size();i++)
+			b.columns[i]->fetch(r,i+1);
+		count++;
 	}
+	return count;
 }
 
 unsigned int result::cols()
@@ -1,28 +1,36 @@
 #include "dbixx.h"
+#include "util.h"
 #include <limits>
 #include <stdio.h>
 
-#if defined(_WIN32) || defined(WIN32) || defined(__WIN32) && !defined(__CYGWIN__)
-#define WIN_NATIVE
-#endif
-
 namespace dbixx {
 using namespace std;
 
 row::~row()
 {
 	if(res && owner) {
-		dbi_result_free(res);
+		release(res,source);
 	}
 }
 
+void row::release(dbi_result r,session *s)
+{
+	if(s)
+		s->detach(r);
+	else
+		dbi_result_free(r);
+}
+
 void row::reset()
 {
 	if(res && owner) {
-		dbi_result_free(res);
+		release(res,source);
 	}
 	res=NULL;
 	owner=false;
+	info=NULL;
+	source=NULL;
+	own_info.clear();
 }
 
 bool row::isempty()
@@ -32,36 +40,57 @@ bool row::isempty()
 
 unsigned int row::cols()
 {
-	unsigned c;
-	if(res && (c=dbi_result_get_numfields(res))!=DBI_FIELD_ERROR) {
-		return c;
+	if(res) {
+		if(info)
+			return info->size();
+		unsigned n=dbi_result_get_numfields(res);
+		if(n!=DBI_FIELD_ERROR)
+			return n;
 	}
 	throw dbixx_error("Failed to fetch number of columns");
 }
 
-void row::set(dbi_result &r)
+void row::set(dbi_result &r,schema const *s)
 {
 	if(res && r!=res && owner) {
-		dbi_result_free(res);
+		release(res,source);
 	}
 	owner=false;
+	source=NULL;
 	res=r;
+	info=s;
 	current=0;
 }
 
-void row::assign(dbi_result &r)
+void row::assign(dbi_result &r,session *s)
 {
 	if(res && r!=res && owner) {
-		dbi_result_free(res);
+		release(res,source);
 	}
 	owner=true;
+	source=s;
+	if(s)
+		s->attach();
 	res=r;
 	current=0;
+	info=NULL;
+	own_info.clear();
 	if(!dbi_result_next_row(res)) {
 		reset();
+		return;
 	}
 }
 
+schema const &row::get_info()
+{
+	// Single rows are often read by position only, load the names on demand
+	if(!info) {
+		own_info.load(res);
+		info=&own_info;
+	}
+	return *info;
+}
+
 void row::check_set()
 {
 	if(!res)
@@ -80,14 +109,23 @@ bool row::isnull(int inx)
 }
 
 bool row::isnull(std::string const &id)
+{
+	return isnull(index(id));
+}
+
+int row::index(std::string const &name)
 {
 	check_set();
-	int r;
-	r=dbi_result_field_is_null(res,id.c_str());
-	if(r == DBI_FIELD_FLAG_ERROR ) {
+	int pos=get_info().find(name);
+	if(pos==0)
 		throw dbixx_error("Invalid field");
-	}
-	return r;
+	return pos;
+}
+
+schema const &row::columns()
+{
+	check_set();
+	return get_info();
 }
 
 template<typename T>
@@ -126,7 +164,7 @@ bool row::fetch(int pos,unsigned long &v) { return ufetch(pos,v); }
 bool row::fetch(int pos,long long &v)
 {
 	if(isnull(pos)) return false;
-	int type=dbi_result_get_field_type_idx(res,pos);
+	int type=this->type(pos);
 	switch(type) {
 	case DBI_TYPE_INTEGER:
 	case DBI_TYPE_DECIMAL:
@@ -145,7 +183,7 @@ bool row::fetch(int pos,long long &v)
 bool row::fetch(int pos,unsigned long long &v)
 {
 	if(isnull(pos)) return false;
-	int type=dbi_result_get_field_type_idx(res,pos);
+	int type=this->type(pos);
 	switch(type) {
 	case DBI_TYPE_INTEGER:
 	case DBI_TYPE_DECIMAL:
@@ -164,15 +202,18 @@ bool row::fetch(int pos,unsigned long long &v)
 bool row::fetch(int pos,string &v)
 {
 	char const *tmp;
+	size_t len;
 	if(isnull(pos)) return false;
-	int type=dbi_result_get_field_type_idx(res,pos);
+	int type=this->type(pos);
 	switch(type) {
 	case DBI_TYPE_STRING:
 		tmp=dbi_result_get_string_idx(res,pos);
-		if(tmp)
-			v=tmp;
-		else
+		if(!tmp)
 			return false;
+		len=dbi_result_get_field_length_idx(res,pos);
+		if(len==DBI_LENGTH_ERROR)
+			len=strlen(tmp);
+		v.assign(tmp,len);
 		break;
 	default:
 		dbixx_error("Bad cast to string type");
@@ -180,6 +221,43 @@ bool row::fetch(int pos,string &v)
 	return true;	
 }
 
+bool row::fetch_view(int pos,char const *&v,size_t &len)
+{
+	if(isnull(pos)) return false;
+	if(type(pos)!=DBI_TYPE_STRING)
+		throw dbixx_error("Bad cast to string type");
+	v=dbi_result_get_string_idx(res,pos);
+	if(!v)
+		return false;
+	len=dbi_result_get_field_length_idx(res,pos);
+	if(len==DBI_LENGTH_ERROR)
+		len=strlen(v);
+	return true;
+}
+
+bool row::fetch_binary(int pos,unsigned char const *&v,size_t &len)
+{
+	if(isnull(pos)) return false;
+	int type=this->type(pos);
+	if(type!=DBI_TYPE_BINARY && type!=DBI_TYPE_STRING)
+		throw dbixx_error("Bad cast to binary type");
+	if(type==DBI_TYPE_STRING) {
+		// libdbi returns NULL for binary access to string fields
+		char const *s=NULL;
+		if(!fetch_view(pos,s,len))
+			return false;
+		v=reinterpret_cast<unsigned char const *>(s);
+		return true;
+	}
+	len=dbi_result_get_field_length_idx(res,pos);
+	if(len==DBI_LENGTH_ERROR)
+		throw dbixx_error("Failed to fetch field length");
+	v=dbi_result_get_binary_idx(res,pos);
+	if(!v)
+		return false;
+	return true;
+}
+
 bool row::fetch(int pos,float &v)
 {
 	double tmp;
@@ -201,10 +279,10 @@ bool row::fetch(int pos,long double &v)
 bool row::fetch(int pos,double &v)
 {
 	if(isnull(pos)) return false;
-	int type=dbi_result_get_field_type_idx(res,pos);
+	int type=this->type(pos);
 	switch(type) {
 	case DBI_TYPE_DECIMAL:
-		if(dbi_result_get_field_attribs_idx(res,pos) & DBI_DECIMAL_SIZE8)
+		if(attribs(pos) & DBI_DECIMAL_SIZE8)
 			v=dbi_result_get_double_idx(res,pos);
 		else
 			v=dbi_result_get_float_idx(res,pos);
@@ -224,17 +302,13 @@ bool row::fetch(int pos,double &v)
 bool row::fetch(int pos,std::tm &t)
 {
 	if(isnull(pos)) return false;
-	int type=dbi_result_get_field_type_idx(res,pos);
+	int type=this->type(pos);
 	time_t v;
 	switch(type) {
 	case DBI_TYPE_DATETIME:
 		v=dbi_result_get_datetime_idx(res,pos);
 		std::tm tmp;
-		#ifdef WIN_NATIVE
-		tmp=*gmtime(&v);
-		#else
-		gmtime_r(&v,&tmp);
-		#endif
+		utc_time(v,tmp);
 		memset(&t,0,sizeof(t));
 		t.tm_year = tmp.tm_year;
 		t.tm_mon = tmp.tm_mon;
@@ -1,25 +1,82 @@
 #include "dbixx.h"
+#include "cache.h"
+#include "replicas.h"
+#include "util.h"
 #include <stdio.h>
-#include <limits>
-#include <iomanip>
-#include <sstream>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <pthread.h>
 
 namespace dbixx {
 
 using namespace std;
 
 
-class loader {
-public:
-	loader() { dbi_initialize(NULL); };
-	~loader() { dbi_shutdown(); };
-};
+instance::instance(char const *driver_dir)
+{
+	inst=NULL;
+	if(dbi_initialize_r(driver_dir,&inst) < 0)
+		throw dbixx_error("Failed to initialize libdbi");
+}
+
+instance::~instance()
+{
+	dbi_shutdown_r(inst);
+}
 
-static loader backend_loader;
+static instance *default_instance;
+static pthread_once_t default_instance_once = PTHREAD_ONCE_INIT;
 
-session::session()
+static void create_default_instance()
+{
+	// Never destroyed, sessions in static objects may outlive any other static object
+	try {
+		default_instance=new instance();
+	}
+	catch(...) {
+	}
+}
+
+instance &instance::global()
+{
+	pthread_once(&default_instance_once,create_default_instance);
+	if(!default_instance)
+		throw dbixx_error("Failed to initialize libdbi");
+	return *default_instance;
+}
+
+void session::init()
 {
+	inst=NULL;
 	conn=NULL;
+	templates_limit=64;
+	template_hits=0;
+	template_misses=0;
+	use_server_prepare=false;
+	statements_counter=0;
+	conn_generation=0;
+	transactions=0;
+	monitor=NULL;
+	held_results=0;
+	last_error=DBI_ERROR_NONE;
+	retries_counter=0;
+	retry_seed=static_cast<unsigned>(time(NULL)) ^ static_cast<unsigned>(reinterpret_cast<size_t>(this));
+	results_cache=NULL;
+	written_all=false;
+	read_replicas=NULL;
+	affected_rows=0;
+}
+
+session::session()
+{
+	init();
+}
+
+session::session(instance &i)
+{
+	init();
+	inst=&i;
 }
 
 void session::connect(std::string const &connection_string)
@@ -110,20 +167,23 @@ void session::connect()
 	map<string,string>::const_iterator sp;
 	for(sp=string_params.begin();sp!=string_params.end();sp++){
 		if(dbi_conn_set_option(conn,sp->first.c_str(),sp->second.c_str())) {
-			error();
+			error(std::string());
 		}
 	}
 
 	map<string,int>::const_iterator ip;
 	for(ip=numeric_params.begin();ip!=numeric_params.end();ip++){
 		if(dbi_conn_set_option_numeric(conn,ip->first.c_str(),ip->second)) {
-			error();
+			error(std::string());
 		}
 	}
 
 	if(dbi_conn_connect(conn)<0) {
-		error();
+		error(std::string());
 	}
+	// Statements prepared on previous connection are gone
+	conn_generation++;
+	last_error=DBI_ERROR_NONE;
 }
 
 void session::reconnect()
@@ -135,14 +195,32 @@ void session::reconnect()
 
 session::session(string const &backend_or_conn_str)
 {
-	conn=NULL;
+	init();
+	open(backend_or_conn_str);
+}
+
+session::session(string const &backend_or_conn_str,instance &i)
+{
+	init();
+	inst=&i;
+	open(backend_or_conn_str);
+}
 
+void session::open(string const &backend_or_conn_str)
+{
 	if(backend_or_conn_str.find(':')==std::string::npos)
 		driver(backend_or_conn_str);
 	else
 		connect(backend_or_conn_str);
 }
 
+bool session::ping()
+{
+	if(!conn)
+		return false;
+	return dbi_conn_ping(conn)==1;
+}
+
 void session::close()
 {
 	if(conn) {
@@ -153,14 +231,17 @@ void session::close()
 
 session::~session()
 {
+	close_replicas();
 	close();
 }
 
 void session::driver(string const &backend)
 {
 	close();
+	if(!inst)
+		inst=&instance::global();
 	this->backend=backend;
-	conn=dbi_conn_new(backend.c_str());
+	conn=dbi_conn_new_r(backend.c_str(),inst->get_dbi_inst());
 	if(!conn) {
 		throw dbixx_error("Failed to load backend");
 	}
@@ -182,11 +263,11 @@ unsigned long long session::rowid(char const *name)
 	return dbi_conn_sequence_last(conn,name);
 }
 
-void session::error()
+void session::error(std::string const &q)
 {
-	char const *e;
-	dbi_conn_error(conn,&e);
-	throw dbixx_error(e,escaped_query);
+	char const *e=NULL;
+	last_error=dbi_conn_error(conn,&e);
+	throw dbixx_error(e ? e : "Unknown error",q);
 }
 
 void session::param(string const &par,string const &val)
@@ -199,131 +280,254 @@ void session::param(string const &par,int val)
 	numeric_params[par]=val;
 }
 
-void session::escape()
+void session::parse_template(std::string const &q,query_template &t)
 {
-	while(pos_read<query_in.size()) {
-		if(query_in[pos_read]=='\'') {
-			escaped_query+='\'';
-			pos_read++;
-			while(query_in[pos_read]!='\'' && pos_read!=query_in.size()){
-				escaped_query+=query_in[pos_read];
-				pos_read++;
-			}
-			if(pos_read==query_in.size())
+	t.chunks.clear();
+	t.chunks.push_back(std::string());
+	size_t pos=0;
+	while(pos<q.size()) {
+		if(q[pos]=='\'') {
+			size_t end=q.find('\'',pos+1);
+			if(end==std::string::npos)
 				throw dbixx_error("Unexpected end of query after \"'\"");
-			escaped_query+='\'';
-			pos_read++;
-			continue;
+			t.chunks.back().append(q,pos,end+1-pos);
+			pos=end+1;
 		}
-		if(query_in[pos_read]=='?') {
-			ready_for_input=true;
-			pos_read++;
-			break;
+		else if(q[pos]=='?') {
+			t.chunks.push_back(std::string());
+			pos++;
 		}
-		escaped_query+=query_in[pos_read];
-		pos_read++;
+		else {
+			size_t end=q.find_first_of("'?",pos);
+			if(end==std::string::npos)
+				end=q.size();
+			t.chunks.back().append(q,pos,end-pos);
+			pos=end;
+		}
+	}
+}
+
+session::query_template &session::get_template(std::string const &q)
+{
+	if(templates_limit==0) {
+		template_misses++;
+		parse_template(q,uncached_template);
+		uncached_text=q;
+		uncached_template.text=&uncached_text;
+		return uncached_template;
+	}
+	templates_index_type::iterator p=templates_index.find(q);
+	if(p!=templates_index.end()) {
+		template_hits++;
+		templates.splice(templates.begin(),templates,p->second);
+		return *p->second;
+	}
+	template_misses++;
+	query_template tmp;
+	parse_template(q,tmp);
+	evict_templates(templates_limit-1);
+	templates.push_front(query_template());
+	templates.front().chunks.swap(tmp.chunks);
+	try {
+		p=templates_index.insert(std::make_pair(q,templates.begin())).first;
+	}
+	catch(...) {
+		templates.pop_front();
+		throw;
+	}
+	templates.front().text=&p->first;
+	return templates.front();
+}
+
+void session::template_cache_size(size_t n)
+{
+	templates_limit=n;
+	evict_templates(n);
+}
+
+void session::evict_templates(size_t n)
+{
+	while(templates.size() > n) {
+		query_template &t=templates.back();
+		if(&t==state.current_template) {
+			state.current_template=NULL;
+			state.ready_for_input=false;
+			state.complete=false;
+		}
+		deallocate_native(t);
+		templates_index.erase(*t.text);
+		templates.pop_back();
 	}
-	if(ready_for_input)
+}
+
+void session::server_prepare(bool enable)
+{
+	use_server_prepare=enable;
+}
+
+static void append_statement_name(std::string &s,unsigned id)
+{
+	char buf[32];
+	snprintf(buf,sizeof(buf),"dbixx_%u",id);
+	s+=buf;
+}
+
+unsigned session::next_statement_id()
+{
+	return ++statements_counter;
+}
+
+void session::deallocate_native(query_template const &t)
+{
+	if(!conn || t.prepared_id==0 || t.prepared_generation!=conn_generation)
 		return;
-	if(pos_read==query_in.size()) {
-		complete=true;
+	std::string q="DEALLOCATE ";
+	append_statement_name(q,t.prepared_id);
+	// Failure is harmless, the statement would be released with the connection
+	dbi_result res=dbi_conn_query(conn,q.c_str());
+	if(res)
+		dbi_result_free(res);
+}
+
+void session::prepare_native(query_state &st)
+{
+	if(!st.native_query)
 		return;
+	query_template &t=*st.current_template;
+	if(t.prepared_generation==conn_generation)
+		return;
+	std::string q="PREPARE ";
+	append_statement_name(q,t.prepared_id);
+	q+=" AS ";
+	for(unsigned i=0;i<t.chunks.size();i++) {
+		if(i > 0) {
+			char buf[16];
+			snprintf(buf,sizeof(buf),"$%u",i);
+			q+=buf;
+		}
+		q+=t.chunks[i];
+	}
+	dbi_result res=dbi_conn_query(conn,q.c_str());
+	if(!res) {
+		t.prepare_failed=true;
+		error(q);
+	}
+	dbi_result_free(res);
+	t.prepared_generation=conn_generation;
+}
+
+void session::query_state::escape()
+{
+	size_t n=current_template->chunks.size();
+	if(!native_query) {
+		escaped_query+=current_template->chunks[current_chunk];
+	}
+	else if(current_chunk==0) {
+		escaped_query+="EXECUTE ";
+		append_statement_name(escaped_query,current_template->prepared_id);
+		escaped_query+='(';
+	}
+	else {
+		escaped_query+= current_chunk+1 < n ? ',' : ')';
 	}
-	throw dbixx_error("Internal dbixx error");
+	current_chunk++;
+	if(current_chunk < n)
+		ready_for_input=true;
+	else
+		complete=true;
 }
 
-void session::check_input()
+void session::query_state::check_input()
 {
 	if(!ready_for_input) {
 		throw dbixx_error("More parameters given then inputs in query");
 	}
 }
 
-template<typename T>
-void session::do_bind(T v,bool is_null)
+//
+// Fast formatting of bound values, these functions write directly into the query
+// buffer without creating streams or temporary strings
+//
+
+static void append_value(std::string &s,unsigned long long v)
 {
-	check_input();
-	// The representation of a number in decimal form
-	// is more compact then in binary so it should be enough
-	if(is_null) {
-		escaped_query+="NULL";
-	}
-	else {
-		std::ostringstream ss;
-		ss.imbue(std::locale::classic());
-		
-		if(!std::numeric_limits<T>::is_integer) {
-			ss<<std::setprecision(std::numeric_limits<T>::digits10+1);
-		}
+	char buf[24];
+	s.append(buf,format_unsigned(buf,v)-buf);
+}
 
-		ss << v;
-		escaped_query+=ss.str();
-	}
-	ready_for_input=false;
-	escape();
+static void append_value(std::string &s,long long v)
+{
+	char buf[24];
+	s.append(buf,format_signed(buf,v)-buf);
 }
 
-void session::bind(int v,bool isnull) { do_bind(v,isnull); }
-void session::bind(unsigned v,bool isnull) { do_bind(v,isnull); }
-void session::bind(long v,bool isnull) { do_bind(v,isnull); }
-void session::bind(unsigned long v,bool isnull) { do_bind(v,isnull); }
-void session::bind(long long v,bool isnull) { do_bind(v,isnull); }
-void session::bind(unsigned long long v,bool isnull) { do_bind(v,isnull); }
-void session::bind(double v,bool isnull) { do_bind(v,isnull); }
-void session::bind(long double v,bool isnull) { do_bind(v,isnull); }
+static void append_value(std::string &s,int v) { append_value(s,static_cast<long long>(v)); }
+static void append_value(std::string &s,unsigned v) { append_value(s,static_cast<unsigned long long>(v)); }
+static void append_value(std::string &s,long v) { append_value(s,static_cast<long long>(v)); }
+static void append_value(std::string &s,unsigned long v) { append_value(s,static_cast<unsigned long long>(v)); }
 
-void session::bind(std::tm const &v,bool isnull)
+static void append_value(std::string &s,double v)
 {
-	check_input();
-	// The representation of a number in decimal form
-	// is more compact then in binary so it should be enough
-	if(isnull) {
-		escaped_query+="NULL";
+	char buf[64];
+	s.append(buf,format_double(buf,v)-buf);
+}
+
+static void append_value(std::string &s,long double v)
+{
+	char buf[80];
+	s.append(buf,format_long_double(buf,v)-buf);
+}
+
+static void append_value(std::string &s,std::tm const &v)
+{
+	char buf[80];
+	char *p=buf;
+	*p++='\'';
+	p=format_datetime(p,v);
+	*p++='\'';
+	s.append(buf,p-buf);
+}
+
+template<typename T>
+void session::do_bind(query_state &st,T const &v,bool is_null)
+{
+	st.check_input();
+	if(is_null) {
+		st.escaped_query+="NULL";
 	}
 	else {
-		std::ostringstream ss;
-		ss.imbue(std::locale::classic());
-		ss<<std::setfill('0');
-		ss <<"'";
-		ss << std::setw(4) << v.tm_year+1900 <<'-';
-		ss << std::setw(2) << v.tm_mon+1 <<'-';
-		ss << std::setw(2) << v.tm_mday <<' ';
-		ss << std::setw(2) << v.tm_hour <<':';
-		ss << std::setw(2) << v.tm_min  <<':'; 
-		ss << std::setw(2) << v.tm_sec;
-		ss <<"'";
-
-		escaped_query+=ss.str();
+		append_value(st.escaped_query,v);
 	}
-	ready_for_input=false;
-	escape();
+	st.ready_for_input=false;
+	st.escape();
 }
 
-void session::bind(null const &m,bool isnull)
+template<>
+void session::do_bind(query_state &st,null const &,bool)
 {
-	check_input();
-	escaped_query+="NULL";
-	ready_for_input=false;
-	escape();
+	st.check_input();
+	st.escaped_query+="NULL";
+	st.ready_for_input=false;
+	st.escape();
 }
 
-
-void session::bind(string const &s,bool isnull)
+template<>
+void session::do_bind(query_state &st,string const &s,bool isnull)
 {
-	check_input();
+	st.check_input();
 	check_open();
 	if(isnull) {
-		escaped_query+="NULL";
+		st.escaped_query+="NULL";
 	}
 	else {
 		if(s.size()!=0){
 			char *new_str=NULL;
 			size_t sz=dbi_conn_quote_string_copy(conn,s.c_str(),&new_str);
 			if(sz==0) {
-				error();	
+				error(st.escaped_query);
 			}
 			try {
-				escaped_query+=new_str;
+				st.escaped_query+=new_str;
 			}
 			catch(...) {
 				free(new_str);
@@ -332,69 +536,523 @@ void session::bind(string const &s,bool isnull)
 			free(new_str);
 		}
 		else {
-			escaped_query+="\'\'";
+			st.escaped_query+="\'\'";
 		}
 	}
-	ready_for_input=false;
-	escape();
+	st.ready_for_input=false;
+	st.escape();
 }
 
+template<>
+void session::do_bind(query_state &st,blob const &b,bool isnull)
+{
+	st.check_input();
+	check_open();
+	if(isnull) {
+		st.escaped_query+="NULL";
+	}
+	else {
+		unsigned char *new_str=NULL;
+		size_t sz=dbi_conn_quote_binary_copy(conn,static_cast<unsigned char const *>(b.data),b.size,&new_str);
+		if(sz==0) {
+			error(st.escaped_query);
+		}
+		try {
+			st.escaped_query+=reinterpret_cast<char *>(new_str);
+		}
+		catch(...) {
+			free(new_str);
+			throw;
+		};
+		free(new_str);
+	}
+	st.ready_for_input=false;
+	st.escape();
+}
+
+void session::bind(int v,bool isnull) { do_bind(state,v,isnull); }
+void session::bind(unsigned v,bool isnull) { do_bind(state,v,isnull); }
+void session::bind(long v,bool isnull) { do_bind(state,v,isnull); }
+void session::bind(unsigned long v,bool isnull) { do_bind(state,v,isnull); }
+void session::bind(long long v,bool isnull) { do_bind(state,v,isnull); }
+void session::bind(unsigned long long v,bool isnull) { do_bind(state,v,isnull); }
+void session::bind(double v,bool isnull) { do_bind(state,v,isnull); }
+void session::bind(long double v,bool isnull) { do_bind(state,v,isnull); }
+
+void session::bind(std::tm const &v,bool isnull) { do_bind(state,v,isnull); }
+
+void session::bind(null const &m,bool isnull) { do_bind(state,m,isnull); }
 
+void session::bind(string const &s,bool isnull) { do_bind(state,s,isnull); }
+
+void session::bind(blob const &b,bool isnull) { do_bind(state,b,isnull); }
+
+// Binding of statement objects, see statement.cpp
+template void session::do_bind(query_state &,int const &,bool);
+template void session::do_bind(query_state &,unsigned const &,bool);
+template void session::do_bind(query_state &,long const &,bool);
+template void session::do_bind(query_state &,unsigned long const &,bool);
+template void session::do_bind(query_state &,long long const &,bool);
+template void session::do_bind(query_state &,unsigned long long const &,bool);
+template void session::do_bind(query_state &,double const &,bool);
+template void session::do_bind(query_state &,long double const &,bool);
+template void session::do_bind(query_state &,std::tm const &,bool);
 
 void session::query(std::string const &q)
 {
-	complete=false;
-	ready_for_input=false;
-	query_in=q;
-	pos_read=0;
-	escaped_query="";
-	escaped_query.reserve(q.size()*3/2);
-	pos_write=0;
-	escape();
+	query_state &st=state;
+	st.query_started = monitor ? now() : 0;
+	st.query_idempotent=false;
+	st.complete=false;
+	st.ready_for_input=false;
+	st.current_template=&get_template(q);
+	st.current_chunk=0;
+	st.native_query = use_server_prepare
+		&& st.current_template!=&uncached_template
+		&& st.current_template->chunks.size() > 1
+		&& !st.current_template->prepare_failed
+		&& backend=="pgsql";
+	if(st.native_query && st.current_template->prepared_id==0)
+		st.current_template->prepared_id=next_statement_id();
+	st.escaped_query.clear();
+	// Reserving less than the capacity may reallocate the buffer
+	if(st.escaped_query.capacity() < q.size()*3/2)
+		st.escaped_query.reserve(q.size()*3/2);
+	st.escape();
 }
 
-void session::exec()
+void session::close_replicas()
+{
+	for(unsigned i=0;i<replica_sessions.size();i++)
+		delete replica_sessions[i];
+	replica_sessions.clear();
+}
+
+void session::replicas(replica_set *r)
+{
+	close_replicas();
+	read_replicas=r;
+}
+
+dbi_result session::query_replica(query_state &st,session *&source)
+{
+	int id;
+	while((id=read_replicas->acquire())!=-1) {
+		double sent = monitor ? now() : 0;
+		dbi_result res=NULL;
+		std::string err;
+		bool healthy;
+		if(replica_sessions.size() <= unsigned(id))
+			replica_sessions.resize(id+1,NULL);
+		session *&s=replica_sessions[id];
+		try {
+			if(!s)
+				s=new session(read_replicas->connection_string(id),*inst);
+			res=s->send(st.escaped_query,err);
+			// Query errors are reported, only lost connections eject the replica
+			healthy = res || s->alive();
+		}
+		catch(dbixx_error const &) {
+			healthy=false;
+		}
+		catch(...) {
+			read_replicas->release(id,false);
+			throw;
+		}
+		if(!healthy && s && s->held_results==0) {
+			// Otherwise it is kept till its results are released, and replaced on a later failure
+			delete s;
+			s=NULL;
+		}
+		read_replicas->release(id,!healthy);
+		if(healthy) {
+			source=s;
+			if(monitor)
+				notify(st.text().c_str(),st.escaped_query.c_str(),st.query_started,sent,res,err.c_str());
+			if(!res)
+				throw dbixx_error(err,st.escaped_query);
+			return res;
+		}
+	}
+	return NULL;
+}
+
+dbi_result session::run(query_state &st,bool read,session **source)
 {
 	check_open();
-	if(!complete)
+	if(!st.complete)
 		throw dbixx_error("Not all parameters are bind");
-	dbi_result res=dbi_conn_query(conn,escaped_query.c_str());
-	if(!res) error();
+	// Statements like INSERT ... RETURNING are fetched but they are writes
+	bool write = read && writes(st.text());
+	if(read && !write && source && read_replicas && transactions==0 && !st.native_query) {
+		dbi_result res=query_replica(st,*source);
+		if(res)
+			return res;
+	}
+	for(unsigned attempt=1;;attempt++) {
+		try {
+			dbi_result res=run_once(st);
+			if(write && results_cache)
+				invalidate_cached(st.text());
+			return res;
+		}
+		catch(dbixx_error const &e) {
+			if(!recover(st,e,read && !write,attempt))
+				throw;
+		}
+	}
+}
+
+bool session::writes(std::string const &text)
+{
+	std::string tag;
+	return query_cache::written_table(text,tag)!=query_cache::no_write;
+}
+
+bool session::recover(query_state &st,dbixx_error const &e,bool read,unsigned attempt)
+{
+	if(attempt >= retry_settings.max_attempts || transactions > 0)
+		return false;
+	if(!read && !st.query_idempotent && !retry_settings.retry_writes)
+		return false;
+	bool transient=false;
+	for(unsigned i=0;i<retry_settings.transient_errors.size() && !transient;i++)
+		transient=strstr(e.what(),retry_settings.transient_errors[i].c_str())!=NULL;
+	// Not ping(), it may reset the connection and hide the loss of its state
+	bool lost = !transient && !alive();
+	if(!transient && !lost)
+		return false;
+	// Closing the connection would free the results that are still in use
+	if(lost && held_results > 0)
+		return false;
+
+	double delay=retry_settings.initial_delay;
+	for(unsigned i=1;i<attempt && delay < retry_settings.max_delay;i++)
+		delay*=retry_settings.multiplier;
+	if(delay > retry_settings.max_delay)
+		delay=retry_settings.max_delay;
+	// Spread the clients that failed together over time
+	delay*=1.0 - retry_settings.jitter * rand_r(&retry_seed) / RAND_MAX;
+	retries_counter++;
+	if(delay > 0) {
+		timespec ts;
+		ts.tv_sec=time_t(delay);
+		ts.tv_nsec=long((delay - ts.tv_sec) * 1e9);
+		nanosleep(&ts,NULL);
+	}
+	if(lost) {
+		try {
+			reconnect();
+		}
+		catch(dbixx_error const &) {
+			// The server may be still unavailable, next attempt would fail and retry again
+		}
+	}
+	return true;
+}
+
+dbi_result session::send(std::string const &q,std::string &err)
+{
+	if(!conn) {
+		err="Backend is not open";
+		last_error=DBI_ERROR_NOCONN;
+		return NULL;
+	}
+	dbi_result res=dbi_conn_query(conn,q.c_str());
+	last_error=DBI_ERROR_NONE;
+	if(!res) {
+		char const *e=NULL;
+		last_error=dbi_conn_error(conn,&e);
+		err = e ? e : "Unknown error";
+	}
+	return res;
+}
+
+bool session::recycle()
+{
+	// The results that are still alive would use the connection of next user
+	if(held_results > 0 || transactions > 0)
+		return false;
+	for(unsigned i=0;i<replica_sessions.size();i++) {
+		if(replica_sessions[i] && replica_sessions[i]->held_results > 0)
+			return false;
+	}
+	use_server_prepare=false;
+	monitor=NULL;
+	results_cache=NULL;
+	close_replicas();
+	read_replicas=NULL;
+	retry_settings=retry_policy();
+	state=query_state();
+	return true;
+}
+
+bool session::alive()
+{
+	// dbi_conn_ping() of some drivers (pgsql) silently resets a broken connection and reports
+	// success, which hides the loss of the connection state, so check it with a query
+	if(last_error==DBI_ERROR_NOCONN)
+		return false;
+	std::string err;
+	dbi_result res=send("SELECT 1",err);
+	if(!res)
+		return false;
+	release(res);
+	return true;
+}
+
+void session::release(dbi_result res)
+{
+	dbi_result_free(res);
+}
+
+void session::attach()
+{
+	held_results++;
+}
+
+void session::detach(dbi_result res)
+{
+	dbi_result_free(res);
+	held_results--;
+}
+
+dbi_result session::run_once(query_state &st)
+{
+	std::string err;
+	if(!monitor) {
+		prepare_native(st);
+		dbi_result res=send(st.escaped_query,err);
+		if(!res)
+			throw dbixx_error(err,st.escaped_query);
+		return res;
+	}
+	double sent=now();
+	char const *q=st.text().c_str();
+	try {
+		prepare_native(st);
+	}
+	catch(dbixx_error const &e) {
+		notify(q,st.escaped_query.c_str(),st.query_started,sent,NULL,e.what());
+		throw;
+	}
+	dbi_result res=send(st.escaped_query,err);
+	notify(q,st.escaped_query.c_str(),st.query_started,sent,res,err.c_str());
+	if(!res)
+		throw dbixx_error(err,st.escaped_query);
+	return res;
+}
+
+void session::notify(char const *q,char const *text,double started,double sent,dbi_result res,char const *error)
+{
+	query_info info;
+	info.query=q;
+	info.text=text;
+	info.exec_time=now()-sent;
+	// The query could be started before the observer was installed
+	info.bind_time = started > 0 ? sent-started : -1;
+	info.rows=0;
+	info.affected=0;
+	info.error=NULL;
+	if(res) {
+		info.rows=dbi_result_get_numrows(res);
+		info.affected=dbi_result_get_numrows_affected(res);
+	}
+	else {
+		info.error = error && *error ? error : "Unknown error";
+	}
+	try {
+		monitor->on_query(info);
+	}
+	catch(...) {}
+}
+
+void session::exec()
+{
+	affected_rows=exec(state);
+}
+
+unsigned long long session::exec(query_state &st)
+{
+	dbi_result res=run(st);
 	if(dbi_result_get_numrows(res)!=0) {
-		dbi_result_free(res);
+		release(res);
 		throw dbixx_error("exec() query may not return results");
 	}
-	affected_rows=dbi_result_get_numrows_affected(res);
-	dbi_result_free(res);
+	unsigned long long affected=dbi_result_get_numrows_affected(res);
+	release(res);
+	if(results_cache)
+		invalidate_cached(st.text());
+	return affected;
+}
+
+void session::invalidate_cached(std::string const &text)
+{
+	std::string tag;
+	switch(query_cache::written_table(text,tag)) {
+	case query_cache::no_write:
+		break;
+	case query_cache::table_write:
+		results_cache->invalidate(tag);
+		if(transactions > 0 && std::find(written_tags.begin(),written_tags.end(),tag)==written_tags.end())
+			written_tags.push_back(tag);
+		break;
+	case query_cache::schema_write:
+		results_cache->clear();
+		if(transactions > 0)
+			written_all=true;
+		break;
+	}
+}
+
+void session::end_transaction(bool commited)
+{
+	transactions--;
+	if(transactions > 0)
+		return;
+	// Other sessions could cache the old data till the changes became visible
+	if(commited && results_cache) {
+		if(written_all)
+			results_cache->clear();
+		else
+			for(unsigned i=0;i<written_tags.size();i++)
+				results_cache->invalidate(written_tags[i]);
+	}
+	written_tags.clear();
+	written_all=false;
+}
+
+void session::exec_text(std::string &q,std::string const &key)
+{
+	// Execute already escaped text, keep both buffers to reuse their memory,
+	// the template only names the query for the observer and the cache
+	query_template batch_template;
+	batch_template.text=&key;
+	query_state &st=state;
+	st.escaped_query.swap(q);
+	st.native_query=false;
+	st.current_template=&batch_template;
+	st.query_started=0;
+	st.complete=true;
+	try {
+		affected_rows=exec(st);
+	}
+	catch(...) {
+		st.escaped_query.swap(q);
+		st.current_template=NULL;
+		st.complete=false;
+		throw;
+	}
+	st.escaped_query.swap(q);
+	st.current_template=NULL;
+	st.complete=false;
 }
 
 void session::fetch(result &r)
 {
-	check_open();
-	if(!complete)
+	fetch(state,r);
+}
+
+void session::fetch(query_state &st,result &r)
+{
+	session *source=this;
+	dbi_result res=run(st,true,&source);
+	r.assign(res,source);
+}
+
+void session::fetch(table &t)
+{
+	fetch(state,t);
+}
+
+void session::fetch(query_state &st,table &t)
+{
+	if(!results_cache || transactions > 0 || writes(st.text())) {
+		result r;
+		fetch(st,r);
+		r.materialize(t);
+		return;
+	}
+	if(!st.complete)
 		throw dbixx_error("Not all parameters are bind");
-	dbi_result res=dbi_conn_query(conn,escaped_query.c_str());
-	if(!res) error();
-	r.assign(res);
+	std::string const &text = st.text();
+	std::string native_key;
+	std::string const *key=&st.escaped_query;
+	if(st.native_query) {
+		// Statement names differ between connections, use the query with its parameters
+		native_key=text;
+		native_key.append(st.escaped_query,st.escaped_query.find('('),std::string::npos);
+		key=&native_key;
+	}
+	if(results_cache->get(*key,t))
+		return;
+	unsigned long long generation=results_cache->generation();
+	result r;
+	fetch(st,r);
+	r.materialize(t);
+	std::vector<std::string> tags;
+	query_cache::read_tags(text,tags);
+	results_cache->store(*key,t,tags,-1,generation);
 }
 
-bool session::single(row &r)
+dbi_result session::raw_query(std::string const &q,std::string const &key)
+{
+	check_open();
+	double sent = monitor ? now() : 0;
+	std::string err;
+	dbi_result res=send(q,err);
+	if(monitor)
+		notify(key.c_str(),q.c_str(),0,sent,res,err.c_str());
+	if(!res)
+		throw dbixx_error(err,q);
+	return res;
+}
+
+void session::fetch_stream(result &r,unsigned batch)
 {
+	query_state &st=state;
+	// A cursor WITH HOLD is materialized by the server on commit, so the whole
+	// result would be stored anyway, require the caller to keep the transaction open
+	if(transactions==0)
+		throw dbixx_error("Streaming result requires active transaction",st.text());
+	if(backend!="pgsql" || st.native_query || batch==0) {
+		fetch(r);
+		return;
+	}
 	check_open();
-	if(!complete)
+	if(!st.complete)
 		throw dbixx_error("Not all parameters are bind");
-	dbi_result res=dbi_conn_query(conn,escaped_query.c_str());
-	if(!res) error();
+	r.assign(NULL,NULL);
+	char name[32];
+	snprintf(name,sizeof(name),"dbixx_cursor_%u",next_statement_id());
+	std::string q="DECLARE ";
+	q+=name;
+	q+=" NO SCROLL CURSOR FOR ";
+	q+=st.escaped_query;
+	release(raw_query(q,st.text()));
+	r.start_stream(this,name,batch);
+}
+
+bool session::single(row &r)
+{
+	return single(state,r);
+}
+
+bool session::single(query_state &st,row &r)
+{
+	session *source=this;
+	dbi_result res=run(st,true,&source);
 	int n;
 	if((n=dbi_result_get_numrows(res))!=0 && n!=1) {
-		dbi_result_free(res);
+		source->release(res);
 		throw dbixx_error("signle() must return 1 or 0 rows");
 	}
 	if(n==1) {
-		r.assign(res);
+		r.assign(res,source);
 		return true;
 	}
 	else {
+		source->release(res);
 		r.reset();
 	}
 	return false;
@@ -404,27 +1062,58 @@ transaction::~transaction()
 {
 	if(!commited){
 		try {
-			sql<<"ROLLBACK",exec();
+			if(level==0) {
+				sql<<"ROLLBACK",exec();
+			}
+			else {
+				savepoint("ROLLBACK TO SAVEPOINT ");
+				savepoint("RELEASE SAVEPOINT ");
+			}
 		}
 		catch(...){}
+		sql.end_transaction(false);
 	}
 }
 
+void transaction::savepoint(char const *command)
+{
+	std::string q=command;
+	q+="dbixx_savepoint_";
+	append_value(q,level);
+	sql<<q,exec();
+}
+
 void transaction::begin()
 {
-	sql<<"BEGIN",exec();
+	level=sql.transactions;
+	if(level==0)
+		sql<<"BEGIN",exec();
+	else
+		savepoint("SAVEPOINT ");
+	sql.transactions++;
 }
 
 void transaction::commit()
 {
-	sql<<"COMMIT",exec();
+	if(level==0)
+		sql<<"COMMIT",exec();
+	else
+		savepoint("RELEASE SAVEPOINT ");
 	commited=true;
+	sql.end_transaction(true);
 }
 
 void transaction::rollback()
 {
-	sql<<"ROLLBACK",exec();
+	if(level==0) {
+		sql<<"ROLLBACK",exec();
+	}
+	else {
+		savepoint("ROLLBACK TO SAVEPOINT ");
+		savepoint("RELEASE SAVEPOINT ");
+	}
 	commited=true;
+	sql.end_transaction(false);
 }
 
 } // END OF NAMESPACE DBIXX
@@ -0,0 +1,76 @@
+#include "dbixx.h"
+#include "util.h"
+
+namespace dbixx {
+
+statement::statement(session &s,std::string const &query) :
+	sql(s),
+	text(query),
+	affected_rows(0)
+{
+	session::parse_template(text,tmpl);
+	tmpl.text=&text;
+	state.current_template=&tmpl;
+	state.escaped_query.reserve(text.size()*3/2);
+	reset();
+}
+
+statement::~statement()
+{
+	try {
+		sql.deallocate_native(tmpl);
+	}
+	catch(...) {}
+}
+
+void statement::reset()
+{
+	state.query_started = sql.monitor ? now() : 0;
+	state.complete=false;
+	state.ready_for_input=false;
+	state.current_chunk=0;
+	state.native_query = sql.use_server_prepare
+		&& tmpl.chunks.size() > 1
+		&& !tmpl.prepare_failed
+		&& sql.backend=="pgsql";
+	if(state.native_query && tmpl.prepared_id==0)
+		tmpl.prepared_id=sql.next_statement_id();
+	// Keeps the capacity, so rebinding does not allocate once the buffer is large enough
+	state.escaped_query.clear();
+	state.escape();
+}
+
+void statement::bind(std::string const &v,bool isnull) { sql.do_bind(state,v,isnull); }
+void statement::bind(int v,bool isnull) { sql.do_bind(state,v,isnull); }
+void statement::bind(unsigned v,bool isnull) { sql.do_bind(state,v,isnull); }
+void statement::bind(long v,bool isnull) { sql.do_bind(state,v,isnull); }
+void statement::bind(unsigned long v,bool isnull) { sql.do_bind(state,v,isnull); }
+void statement::bind(long long v,bool isnull) { sql.do_bind(state,v,isnull); }
+void statement::bind(unsigned long long v,bool isnull) { sql.do_bind(state,v,isnull); }
+void statement::bind(double v,bool isnull) { sql.do_bind(state,v,isnull); }
+void statement::bind(long double v,bool isnull) { sql.do_bind(state,v,isnull); }
+void statement::bind(std::tm const &v,bool isnull) { sql.do_bind(state,v,isnull); }
+void statement::bind(null const &v,bool isnull) { sql.do_bind(state,v,isnull); }
+void statement::bind(blob const &v,bool isnull) { sql.do_bind(state,v,isnull); }
+
+void statement::exec()
+{
+	affected_rows=sql.exec(state);
+}
+
+void statement::fetch(result &r)
+{
+	sql.fetch(state,r);
+}
+
+void statement::fetch(table &t)
+{
+	sql.fetch(state,t);
+}
+
+bool statement::single(row &r)
+{
+	return sql.single(state,r);
+}
+
+} // dbixx
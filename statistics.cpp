@@ -0,0 +1,88 @@
+#include "statistics.h"
+
+namespace dbixx {
+
+query_statistics::entry::entry() :
+	count(0),
+	errors(0),
+	rows(0),
+	bind_count(0),
+	bind_time(0),
+	exec_time(0),
+	max_time(0)
+{
+	memset(histogram,0,sizeof(histogram));
+}
+
+double query_statistics::entry::percentile(double p) const
+{
+	unsigned long long limit=static_cast<unsigned long long>(count * p);
+	unsigned long long sum=0;
+	for(int i=0;i<buckets;i++) {
+		sum+=histogram[i];
+		if(sum > limit) {
+			// upper bound of the bucket
+			double upper=double((1ULL << (i+1)) - 1);
+			return upper < max_time ? upper : max_time;
+		}
+	}
+	return max_time;
+}
+
+void query_statistics::on_query(query_info const &info)
+{
+	double us=info.exec_time * 1e6;
+	if(us < 0)
+		us=0;
+	int bucket=0;
+	for(unsigned long long v=static_cast<unsigned long long>(us)+1;v > 1 && bucket < buckets-1;v>>=1)
+		bucket++;
+
+	mutex::guard g(lock_);
+	entry &e=queries[info.query];
+	e.count++;
+	if(info.error)
+		e.errors++;
+	e.rows+=info.rows;
+	if(info.bind_time >= 0) {
+		e.bind_count++;
+		e.bind_time+=info.bind_time * 1e6;
+	}
+	e.exec_time+=us;
+	if(us > e.max_time)
+		e.max_time=us;
+	e.histogram[bucket]++;
+}
+
+void query_statistics::reset()
+{
+	mutex::guard g(lock_);
+	queries.clear();
+}
+
+void query_statistics::dump(std::ostream &out)
+{
+	mutex::guard g(lock_);
+	std::map<std::string,entry>::const_iterator p;
+	for(p=queries.begin();p!=queries.end();++p) {
+		entry const &e=p->second;
+		std::string q=p->first;
+		for(size_t i=0;i<q.size();i++) {
+			if(q[i]=='\t' || q[i]=='\n' || q[i]=='\r')
+				q[i]=' ';
+		}
+		out	<< q << '\t'
+			<< e.count << '\t'
+			<< e.errors << '\t'
+			<< e.rows << '\t'
+			<< (e.bind_count ? e.bind_time / e.bind_count : 0) << '\t'
+			<< e.exec_time / e.count << '\t'
+			<< e.percentile(0.50) << '\t'
+			<< e.percentile(0.95) << '\t'
+			<< e.percentile(0.99) << '\t'
+			<< e.max_time << '\n';
+	}
+	out.flush();
+}
+
+} // dbixx
@@ -0,0 +1,66 @@
+#ifndef _DBIXX_STATISTICS_H_
+#define _DBIXX_STATISTICS_H_
+
+#include "dbixx.h"
+#include "mutex.h"
+#include <ostream>
+#include <map>
+
+namespace dbixx {
+
+///
+/// \brief Thread safe query observer that collects latency histograms per query
+///
+/// Queries are grouped by their text given to session::query() so same statement with different
+/// parameters is counted together. Execution times are kept in logarithmic buckets of
+/// microseconds, so the percentiles are reported with precision of power of 2.
+///
+/// \code
+///  dbixx::query_statistics stats;
+///  sql.observer(&stats);
+///  ...
+///  stats.dump(std::cerr);
+/// \endcode
+///
+class query_statistics : public query_observer {
+	// non copyable
+	query_statistics(query_statistics const &);
+	query_statistics const &operator=(query_statistics const &);
+public:
+	query_statistics() {}
+	///
+	/// Account the executed query
+	///
+	virtual void on_query(query_info const &info);
+	///
+	/// Write the collected statistics to \a out, one line per query with tab separated columns:
+	/// query, count, errors, rows, average bind time, average execution time, 50%, 95% and 99%
+	/// percentiles and maximum of execution time. All times are in microseconds, the average bind time
+	/// is taken over the queries where it is known.
+	///
+	void dump(std::ostream &out);
+	///
+	/// Remove all collected data
+	///
+	void reset();
+private:
+	enum { buckets = 32 };
+	struct entry {
+		entry();
+		unsigned long long count;
+		unsigned long long errors;
+		unsigned long long rows;
+		unsigned long long bind_count;
+		double bind_time;
+		double exec_time;
+		double max_time;
+		unsigned long long histogram[buckets];
+		double percentile(double p) const;
+	};
+	std::map<std::string,entry> queries;
+	mutex lock_;
+};
+
+} // dbixx
+
+#endif // _DBIXX_STATISTICS_H_
@@ -0,0 +1,341 @@
+#include "table.h"
+#include "util.h"
+#include <limits>
+#include <stdio.h>
+#include <stdlib.h>
+
+namespace dbixx {
+using namespace std;
+
+table::table() : rows_(0)
+{
+}
+
+void table::clear()
+{
+	columns.clear();
+	arena.clear();
+	rows_=0;
+}
+
+void table::swap(table &other)
+{
+	columns.swap(other.columns);
+	arena.swap(other.arena);
+	std::swap(rows_,other.rows_);
+}
+
+size_t table::memory_size() const
+{
+	size_t size=sizeof(*this)+arena.capacity();
+	for(unsigned i=0;i<columns.size();i++) {
+		column const &c=columns[i];
+		size+=sizeof(c)+c.name.capacity()
+			+c.integers.capacity()*sizeof(long long)
+			+c.reals.capacity()*sizeof(double)
+			+c.offsets.capacity()*sizeof(size_t)
+			+c.lengths.capacity()*sizeof(size_t)
+			+c.nulls.capacity();
+	}
+	return size;
+}
+
+int table::index(std::string const &name) const
+{
+	for(unsigned i=0;i<columns.size();i++)
+		if(columns[i].name==name)
+			return i+1;
+	throw dbixx_error("Invalid field");
+}
+
+table::column const &table::get_column(int col) const
+{
+	if(col < 1 || unsigned(col) > columns.size())
+		throw dbixx_error("Invalid field");
+	return columns[col-1];
+}
+
+table::column const &table::get_cell(size_t r,int col) const
+{
+	if(r >= rows_)
+		throw dbixx_error("Row index out of range");
+	return get_column(col);
+}
+
+bool table::isnull(size_t r,int col) const
+{
+	column const &c=get_cell(r,col);
+	return (c.nulls[r/8] >> (r%8)) & 1;
+}
+
+template<typename T>
+bool table::fetch_signed(size_t r,int col,T &value) const
+{
+	long long v;
+	bool res=fetch(r,col,v);
+	if(res) {
+		if(v>std::numeric_limits<T>::max() || v < std::numeric_limits<T>::min())
+			throw dbixx_error("Bad cast to integer of small size");
+		value=static_cast<T>(v);
+	}
+	return res;
+}
+
+template<typename T>
+bool table::fetch_unsigned(size_t r,int col,T &value) const
+{
+	unsigned long long v;
+	bool res=fetch(r,col,v);
+	if(res) {
+		if(v>std::numeric_limits<T>::max())
+			throw dbixx_error("Bad cast to integer of small size");
+		value=static_cast<T>(v);
+	}
+	return res;
+}
+
+bool table::fetch(size_t r,int col,short &v) const { return fetch_signed(r,col,v); }
+bool table::fetch(size_t r,int col,int &v) const { return fetch_signed(r,col,v); }
+bool table::fetch(size_t r,int col,long &v) const { return fetch_signed(r,col,v); }
+bool table::fetch(size_t r,int col,unsigned short &v) const { return fetch_unsigned(r,col,v); }
+bool table::fetch(size_t r,int col,unsigned &v) const { return fetch_unsigned(r,col,v); }
+bool table::fetch(size_t r,int col,unsigned long &v) const { return fetch_unsigned(r,col,v); }
+
+bool table::fetch(size_t r,int col,long long &v) const
+{
+	if(isnull(r,col)) return false;
+	column const &c=columns[col-1];
+	switch(c.kind) {
+	case integer_storage:
+	case datetime_storage:
+		v=c.integers[r];
+		break;
+	case real_storage:
+		v=static_cast<long long>(c.reals[r]);
+		break;
+	case text_storage:
+		if(sscanf(&arena[c.offsets[r]],"%lld",&v)!=1)
+			throw dbixx_error("Bad cast to integer type");
+		break;
+	}
+	return true;
+}
+
+bool table::fetch(size_t r,int col,unsigned long long &v) const
+{
+	if(isnull(r,col)) return false;
+	column const &c=columns[col-1];
+	switch(c.kind) {
+	case integer_storage:
+	case datetime_storage:
+		v=static_cast<unsigned long long>(c.integers[r]);
+		break;
+	case real_storage:
+		v=static_cast<unsigned long long>(c.reals[r]);
+		break;
+	case text_storage:
+		if(sscanf(&arena[c.offsets[r]],"%llu",&v)!=1)
+			throw dbixx_error("Bad cast to integer type");
+		break;
+	}
+	return true;
+}
+
+bool table::fetch(size_t r,int col,double &v) const
+{
+	if(isnull(r,col)) return false;
+	column const &c=columns[col-1];
+	switch(c.kind) {
+	case integer_storage:
+		v=static_cast<double>(c.integers[r]);
+		break;
+	case real_storage:
+		v=c.reals[r];
+		break;
+	case text_storage:
+		v=atof(&arena[c.offsets[r]]);
+		break;
+	default:
+		throw dbixx_error("Bad cast to double type");
+	}
+	return true;
+}
+
+bool table::fetch(size_t r,int col,float &v) const
+{
+	double tmp;
+	if(!fetch(r,col,tmp))
+		return false;
+	v=static_cast<float>(tmp);
+	return true;
+}
+
+bool table::fetch(size_t r,int col,long double &v) const
+{
+	double tmp;
+	if(!fetch(r,col,tmp))
+		return false;
+	v=tmp;
+	return true;
+}
+
+bool table::fetch_view(size_t r,int col,char const *&v,size_t &len) const
+{
+	if(isnull(r,col)) return false;
+	column const &c=columns[col-1];
+	if(c.kind!=text_storage)
+		throw dbixx_error("Bad cast to string type");
+	v=&arena[c.offsets[r]];
+	len=c.lengths[r];
+	return true;
+}
+
+bool table::fetch(size_t r,int col,std::string &v) const
+{
+	char const *p;
+	size_t len;
+	if(!fetch_view(r,col,p,len))
+		return false;
+	v.assign(p,len);
+	return true;
+}
+
+bool table::fetch(size_t r,int col,std::tm &t) const
+{
+	if(isnull(r,col)) return false;
+	column const &c=columns[col-1];
+	memset(&t,0,sizeof(t));
+	switch(c.kind) {
+	case datetime_storage:
+		{
+			time_t v=static_cast<time_t>(c.integers[r]);
+			std::tm tmp;
+			utc_time(v,tmp);
+			t.tm_year = tmp.tm_year;
+			t.tm_mon = tmp.tm_mon;
+			t.tm_mday = tmp.tm_mday;
+			t.tm_hour = tmp.tm_hour;
+			t.tm_min = tmp.tm_min;
+			t.tm_sec = tmp.tm_sec;
+		}
+		break;
+	case text_storage:
+		if(sscanf(&arena[c.offsets[r]],"%d-%d-%d %d:%d:%d",
+			&t.tm_year,&t.tm_mon,&t.tm_mday,
+			&t.tm_hour,&t.tm_min,&t.tm_sec)!=6)
+		{
+			throw dbixx_error("Bad cast to datetime type");
+		}
+		t.tm_year-=1900;
+		t.tm_mon-=1;
+		break;
+	default:
+		throw dbixx_error("Bad cast to datetime type");
+	}
+	t.tm_isdst = -1;
+	mktime(&t);
+	return true;
+}
+
+void result::materialize(table &t)
+{
+	if(!res)
+		throw dbixx_error("No result assigned");
+	table tmp;
+	unsigned n=info.size();
+	tmp.columns.resize(n);
+	size_t expected=0;
+	if(!stream_owner) {
+		unsigned long long total=dbi_result_get_numrows(res);
+		unsigned long long current=dbi_result_get_currow(res);
+		if(total > current)
+			expected=total-current;
+	}
+	for(unsigned i=0;i<n;i++) {
+		table::column &c=tmp.columns[i];
+		c.name=info.name(i+1);
+		switch(info.type(i+1)) {
+		case DBI_TYPE_INTEGER:
+			c.kind=table::integer_storage;
+			c.integers.reserve(expected);
+			break;
+		case DBI_TYPE_DECIMAL:
+			c.kind=table::real_storage;
+			c.reals.reserve(expected);
+			break;
+		case DBI_TYPE_DATETIME:
+			c.kind=table::datetime_storage;
+			c.integers.reserve(expected);
+			break;
+		default:
+			c.kind=table::text_storage;
+			c.offsets.reserve(expected);
+			c.lengths.reserve(expected);
+		}
+		c.nulls.reserve((expected+7)/8);
+	}
+
+	row r;
+	size_t count=0;
+	while(next(r)) {
+		if(count%8==0) {
+			for(unsigned i=0;i<n;i++)
+				tmp.columns[i].nulls.push_back(0);
+		}
+		for(unsigned i=0;i<n;i++) {
+			table::column &c=tmp.columns[i];
+			int pos=i+1;
+			bool null=dbi_result_field_is_null_idx(res,pos)==1;
+			if(null)
+				c.nulls[count/8] |= 1 << (count%8);
+			switch(c.kind) {
+			case table::integer_storage:
+				c.integers.push_back(null ? 0 : dbi_result_get_longlong_idx(res,pos));
+				break;
+			case table::datetime_storage:
+				c.integers.push_back(null ? 0 : dbi_result_get_datetime_idx(res,pos));
+				break;
+			case table::real_storage:
+				{
+					double v=0;
+					if(!null) {
+						if(info.attribs(pos) & DBI_DECIMAL_SIZE8)
+							v=dbi_result_get_double_idx(res,pos);
+						else
+							v=dbi_result_get_float_idx(res,pos);
+					}
+					c.reals.push_back(v);
+				}
+				break;
+			case table::text_storage:
+				{
+					char const *p=NULL;
+					size_t len=0;
+					if(!null) {
+						len=dbi_result_get_field_length_idx(res,pos);
+						if(info.type(pos)==DBI_TYPE_BINARY)
+							p=reinterpret_cast<char const *>(dbi_result_get_binary_idx(res,pos));
+						else
+							p=dbi_result_get_string_idx(res,pos);
+						if(p && len==DBI_LENGTH_ERROR)
+							len=strlen(p);
+						if(!p)
+							len=0;
+					}
+					c.offsets.push_back(tmp.arena.size());
+					c.lengths.push_back(len);
+					tmp.arena.insert(tmp.arena.end(),p,p+len);
+					tmp.arena.push_back(0);
+				}
+				break;
+			}
+		}
+		count++;
+	}
+	tmp.rows_=count;
+	// Release the spare capacity of the growing buffer
+	std::vector<char>(tmp.arena).swap(tmp.arena);
+	t.swap(tmp);
+}
+
+} // dbixx
@@ -0,0 +1,155 @@
+#ifndef _DBIXX_TABLE_H_
+#define _DBIXX_TABLE_H_
+
+#include "dbixx.h"
+#include <vector>
+#include <string>
+
+namespace dbixx {
+
+///
+/// \brief Compact in-memory copy of a query result, see result::materialize()
+///
+/// The table keeps fixed width arrays for numeric and date-time columns, a single contiguous
+/// buffer for all text and binary values and a NULL bitmap per column. It does not depend
+/// on the libdbi result or the session, and once filled it may be read concurrently from
+/// several threads.
+///
+/// Rows are numbered from 0 and columns from 1, as in row class.
+///
+class table {
+public:
+	///
+	/// Create an empty table
+	///
+	table();
+	///
+	/// Get number of rows
+	///
+	size_t rows() const { return rows_; }
+	///
+	/// Get number of columns
+	///
+	unsigned cols() const { return columns.size(); }
+	///
+	/// Get the name of column \a col
+	///
+	std::string const &name(int col) const { return get_column(col).name; }
+	///
+	/// Get the position of the column named \a name, throws dbixx_error if there is no such column
+	///
+	int index(std::string const &name) const;
+	///
+	/// Check if the value at row \a r and column \a col is NULL
+	///
+	bool isnull(size_t r,int col) const;
+	///
+	/// Fetch \a value at row \a r and column \a col, returns false if the value is NULL
+	///
+	bool fetch(size_t r,int col,short &value) const;
+	///
+	/// Fetch \a value at row \a r and column \a col, returns false if the value is NULL
+	///
+	bool fetch(size_t r,int col,unsigned short &value) const;
+	///
+	/// Fetch \a value at row \a r and column \a col, returns false if the value is NULL
+	///
+	bool fetch(size_t r,int col,int &value) const;
+	///
+	/// Fetch \a value at row \a r and column \a col, returns false if the value is NULL
+	///
+	bool fetch(size_t r,int col,unsigned &value) const;
+	///
+	/// Fetch \a value at row \a r and column \a col, returns false if the value is NULL
+	///
+	bool fetch(size_t r,int col,long &value) const;
+	///
+	/// Fetch \a value at row \a r and column \a col, returns false if the value is NULL
+	///
+	bool fetch(size_t r,int col,unsigned long &value) const;
+	///
+	/// Fetch \a value at row \a r and column \a col, returns false if the value is NULL
+	///
+	bool fetch(size_t r,int col,long long &value) const;
+	///
+	/// Fetch \a value at row \a r and column \a col, returns false if the value is NULL
+	///
+	bool fetch(size_t r,int col,unsigned long long &value) const;
+	///
+	/// Fetch \a value at row \a r and column \a col, returns false if the value is NULL
+	///
+	bool fetch(size_t r,int col,float &value) const;
+	///
+	/// Fetch \a value at row \a r and column \a col, returns false if the value is NULL
+	///
+	bool fetch(size_t r,int col,double &value) const;
+	///
+	/// Fetch \a value at row \a r and column \a col, returns false if the value is NULL
+	///
+	bool fetch(size_t r,int col,long double &value) const;
+	///
+	/// Fetch \a value at row \a r and column \a col, returns false if the value is NULL
+	///
+	bool fetch(size_t r,int col,std::string &value) const;
+	///
+	/// Fetch \a value at row \a r and column \a col, returns false if the value is NULL
+	///
+	bool fetch(size_t r,int col,std::tm &value) const;
+	///
+	/// Get a pointer to the text or binary data at row \a r and column \a col and its \a length
+	/// without copying, returns false if the value is NULL. Text is NUL terminated.
+	/// The pointer remains valid as long as the table is not modified.
+	///
+	bool fetch_view(size_t r,int col,char const *&value,size_t &length) const;
+	///
+	/// Fetch value at row \a r and column \a col, throws dbixx_error if it is NULL
+	///
+	template<typename T>
+	T get(size_t r,int col) const
+	{
+		T v;
+		if(!fetch(r,col,v)) {
+			throw dbixx_error("Null value fetch");
+		}
+		return v;
+	}
+	///
+	/// Get approximate number of bytes used by the table
+	///
+	size_t memory_size() const;
+	///
+	/// Remove all data
+	///
+	void clear();
+	///
+	/// Swap the content with \a other
+	///
+	void swap(table &other);
+private:
+	enum storage { integer_storage, real_storage, text_storage, datetime_storage };
+	struct column {
+		std::string name;
+		storage kind;
+		std::vector<long long> integers;
+		std::vector<double> reals;
+		std::vector<size_t> offsets;
+		std::vector<size_t> lengths;
+		std::vector<unsigned char> nulls;
+	};
+	column const &get_column(int col) const;
+	column const &get_cell(size_t r,int col) const;
+	template<typename T>
+	bool fetch_signed(size_t r,int col,T &v) const;
+	template<typename T>
+	bool fetch_unsigned(size_t r,int col,T &v) const;
+
+	std::vector<column> columns;
+	std::vector<char> arena;
+	size_t rows_;
+
+	friend class result;
+};
+
+} // dbixx
+
+#endif // _DBIXX_TABLE_H_
@@ -1,8 +1,763 @@
 #include "dbixx.h"
+#include "pool.h"
+#include "replicas.h"
+#include "async.h"
+#include "cache.h"
+#include "import.h"
+#include "statistics.h"
+#include "parallel.h"
+#include <fstream>
+#include <sstream>
+#include <pthread.h>
 #include <iostream>
+
+struct person {
+	int id;
+	std::string name;
+	double score;
+};
+
+DBIXX_MAP_BEGIN(person)
+	DBIXX_FIELD(id)
+	DBIXX_FIELD(name)
+	DBIXX_FIELD(score)
+DBIXX_MAP_END()
+
 using namespace dbixx;
 using namespace std;
 
+static int failures=0;
+
+static void check(bool ok,char const *what)
+{
+	if(!ok) {
+		failures++;
+		cerr<<"FAILED: "<<what<<endl;
+	}
+}
+
+static int count_rows(session &sql,std::string const &table)
+{
+	row r;
+	int n=-1;
+	sql<<"select count(*) from "+table,r;
+	r>>n;
+	return n;
+}
+
+static void test_pool(std::string const &conn_str)
+{
+	pool p(conn_str,2,1);
+	{
+		pooled_session a(p);
+		pooled_session b(p);
+		check(p.size()==2 && p.idle()==0,"pool: two sessions checked out");
+		row r;
+		int v=0;
+		*a<<"select 1",r;
+		r>>v;
+		check(v==1,"pool: checked out session executes queries");
+	}
+	check(p.size()==1 && p.idle()==1,"pool: only max_idle sessions are kept after checkin");
+	{
+		pooled_session d(p);
+		retry_policy policy;
+		policy.max_attempts=5;
+		d->retry(policy);
+		d->server_prepare(true);
+	}
+	{
+		pooled_session d(p);
+		check(!d->server_prepare() && d->retry().max_attempts==1,"pool: settings are reset on checkin");
+	}
+	p.validate_after(0);
+	{
+		pooled_session c(p);
+		check(p.idle()==0,"pool: idle session is reused");
+		row r;
+		check((c.get()<<"select 2",r),"pool: validated session executes queries");
+		c.invalidate();
+	}
+	check(p.size()==0 && p.idle()==0,"pool: invalidated session is closed on checkin");
+}
+
+struct insert_task : public task {
+	insert_task(std::string const &t,int v) : table(t), value(v) {}
+	std::string table;
+	int value;
+	void run(session &sql)
+	{
+		sql<<"insert into "+table+"(n) values(?)",value,exec();
+	}
+};
+
+static bool failed(future f)
+{
+	try {
+		f.get();
+	}
+	catch(dbixx_error const &) {
+		return true;
+	}
+	return false;
+}
+
+static void test_async(session &sql,std::string const &conn_str)
+{
+	sql<<"drop table if exists async_rows",exec();
+	sql<<"create table async_rows ( n integer )",exec();
+	pool p(conn_str,2,2);
+	std::vector<future> done;
+	{
+		async_session async(p,1);
+		insert_task one("async_rows",1),two("async_rows",2),bad("no_such_table",3);
+		done.push_back(async.submit(one));
+		done.push_back(async.exec_async("insert into async_rows(n) values(3)"));
+		future f=async.submit(bad);
+		done.push_back(async.submit(two));
+		check(failed(f),"async: failed task reports the error");
+		for(unsigned i=0;i<done.size();i++)
+			check(!failed(done[i]),"async: task is completed");
+	}
+	check(count_rows(sql,"async_rows")==3,"async: all statements are executed");
+}
+
+static void test_pipeline(session &sql,std::string const &conn_str)
+{
+	sql<<"drop table if exists piped",exec();
+	sql<<"create table piped ( n integer )",exec();
+	result res;
+	table t;
+	{
+		pipeline p(sql);
+		p<<"insert into piped(n) values(?)",1,exec();
+		p<<"insert into piped(n) select n+1 from piped",exec();
+		p<<"select sum(n) from piped",res;
+		p<<"select n from piped order by n",t;
+		check(p.size()==4,"pipeline: statements are queued");
+		p.run();
+		check(p.affected(0)==1 && p.affected(1)==1,"pipeline: affected rows of each statement");
+	}
+	row r;
+	int sum=0;
+	check(res.next(r) && (r>>sum,sum==3),"pipeline: result of a query");
+	check(t.rows()==2 && t.get<int>(1,1)==2,"pipeline: table of a query");
+	pool connections(conn_str,2,2);
+	async_session async(connections,2);
+	table a,b;
+	pipeline p(sql);
+	p<<"select n from piped where n=?",1,a;
+	p<<"select n from piped where n=?",2,b;
+	p.run(async);
+	check(a.rows()==1 && b.rows()==1 && b.get<int>(0,1)==2,"pipeline: concurrent queries");
+}
+
+static void test_group_commit(session &sql,std::string const &conn_str)
+{
+	sql<<"drop table if exists grouped",exec();
+	sql<<"create table grouped ( n integer )",exec();
+	pool p(conn_str,2,2);
+	group_commit writer(p,10,0.05);
+	insert_task one("grouped",1),two("grouped",2),bad("no_such_table",3);
+	future a=writer.submit(one);
+	future f=writer.submit(bad);
+	future b=writer.submit(two);
+	check(failed(f),"group commit: failed task reports the error");
+	check(!failed(a) && !failed(b),"group commit: other tasks are committed");
+	check(count_rows(sql,"grouped")==2,"group commit: rows of other tasks are stored");
+	check(writer.batches() >= 1,"group commit: batches are counted");
+}
+
+struct collect_keys {
+	collect_keys() : ordered(true), last(-1) {}
+	std::vector<int> values;
+	bool ordered;
+	int last;
+	void operator()(int key,table const &t)
+	{
+		ordered = ordered && key > last;
+		last=key;
+		values.push_back(t.rows() ? t.get<int>(0,1) : -1);
+	}
+};
+
+static void test_parallel(std::string const &conn_str)
+{
+	pool p(conn_str,4,4);
+	std::vector<int> keys;
+	for(int i=0;i<50;i++)
+		keys.push_back(i);
+	collect_keys c;
+	parallel_for_each(p,keys,"select ?*2",c,4);
+	bool values=c.values.size()==keys.size();
+	for(unsigned i=0;values && i<keys.size();i++)
+		values=c.values[i]==keys[i]*2;
+	check(values && c.ordered,"parallel: callback is called for each key in order");
+	collect_keys unordered;
+	parallel_for_each(p,keys,"select ?*2",unordered,4,false);
+	check(unordered.values.size()==keys.size(),"parallel: unordered callback is called for each key");
+	collect_keys broken;
+	bool thrown=false;
+	try {
+		parallel_for_each(p,keys,"select ? from no_such_table",broken,4);
+	}
+	catch(dbixx_error const &) {
+		thrown=true;
+	}
+	check(thrown,"parallel: error is thrown");
+}
+
+struct thread_queries {
+	thread_queries() : sql(NULL), wrong(0) {}
+	session *sql;
+	int wrong;
+	static void *run(void *p)
+	{
+		thread_queries *self=static_cast<thread_queries *>(p);
+		try {
+			for(int i=0;i<200;i++) {
+				row r;
+				int v=-1;
+				*self->sql<<"select ?",i,r;
+				r>>v;
+				if(v!=i)
+					self->wrong++;
+			}
+		}
+		catch(dbixx_error const &) {
+			self->wrong++;
+		}
+		return NULL;
+	}
+};
+
+static void test_threads(std::string const &conn_str)
+{
+	instance inst;
+	session own(conn_str,inst);
+	session global(conn_str);
+	session other(conn_str,inst);
+	thread_queries work[3];
+	work[0].sql=&own;
+	work[1].sql=&global;
+	work[2].sql=&other;
+	pthread_t threads[3];
+	for(int i=0;i<3;i++)
+		pthread_create(&threads[i],NULL,thread_queries::run,&work[i]);
+	for(int i=0;i<3;i++)
+		pthread_join(threads[i],NULL);
+	check(work[0].wrong==0 && work[1].wrong==0 && work[2].wrong==0,"threads: sessions are used concurrently");
+	// A session may be handed over to another thread once the first one stopped using it
+	pthread_create(&threads[0],NULL,thread_queries::run,&work[0]);
+	pthread_join(threads[0],NULL);
+	check(work[0].wrong==0,"threads: session is handed over");
+}
+
+static void test_templates(session &sql)
+{
+	sql.template_cache_size(2);
+	unsigned long long hits=sql.template_cache_hits();
+	unsigned long long misses=sql.template_cache_misses();
+	row r;
+	sql<<"select ?",1,r;
+	sql<<"select ?",2,r;
+	check(sql.template_cache_hits()==hits+1 && sql.template_cache_misses()==misses+1,
+		"templates: repeated query is a hit");
+	sql<<"select ?+1",1,r;
+	sql<<"select ?+2",1,r;
+	sql<<"select ?",3,r;
+	check(sql.template_cache_misses()==misses+4,"templates: least recently used template is evicted at limit");
+	sql.template_cache_size(64);
+}
+
+static void test_server_prepare(session &sql)
+{
+	sql.server_prepare(true);
+	check(sql.server_prepare(),"prepare: setting is enabled");
+	for(int i=0;i<3;i++) {
+		row r;
+		int v=0;
+		sql<<"select ?+?",i,10,r;
+		r>>v;
+		check(v==i+10,"prepare: repeated query returns the bound values");
+	}
+	sql.server_prepare(false);
+	check(!sql.server_prepare(),"prepare: setting is disabled");
+}
+
+struct last_query : public query_observer {
+	last_query() : calls(0), rows(0), failed(false) {}
+	void on_query(query_info const &info)
+	{
+		calls++;
+		query=info.query;
+		text=info.text;
+		rows=info.rows;
+		failed=info.error!=NULL;
+	}
+	int calls;
+	std::string query;
+	std::string text;
+	unsigned long long rows;
+	bool failed;
+};
+
+static void test_observer(session &sql)
+{
+	last_query last;
+	sql.observer(&last);
+	row r;
+	sql<<"select ?",5,r;
+	check(last.calls==1 && last.query=="select ?" && last.text=="select 5" && last.rows==1 && !last.failed,
+		"observer: executed query is reported");
+	try {
+		sql<<"select * from no_such_table",exec();
+	}
+	catch(dbixx_error const &) {}
+	check(last.calls==2 && last.failed,"observer: failed query is reported");
+	query_statistics stats;
+	sql.observer(&stats);
+	sql<<"select ?",1,r;
+	sql<<"select ?",2,r;
+	sql.observer(NULL);
+	std::ostringstream out;
+	stats.dump(out);
+	check(out.str().compare(0,11,"select ?\t2\t")==0,"observer: statistics count the queries by text");
+}
+
+static bool throws(session &sql,std::string const &q,bool fetch)
+{
+	try {
+		row r;
+		if(fetch)
+			sql<<q,r;
+		else
+			sql<<q,exec();
+	}
+	catch(dbixx_error const &) {
+		return true;
+	}
+	return false;
+}
+
+static void test_retry(session &sql)
+{
+	retry_policy policy;
+	policy.max_attempts=3;
+	policy.initial_delay=0.001;
+	policy.transient_errors.push_back("no such table");
+	sql.retry(policy);
+	unsigned long long retries=sql.retries();
+	check(throws(sql,"select * from retried",true) && sql.retries()==retries+2,"retry: read is attempted max_attempts times");
+	retries=sql.retries();
+	check(throws(sql,"delete from retried",false) && sql.retries()==retries,"retry: write is not retried");
+	bool thrown=false;
+	try {
+		sql<<"delete from retried";
+		sql.idempotent();
+		sql.exec();
+	}
+	catch(dbixx_error const &) {
+		thrown=true;
+	}
+	check(thrown && sql.retries()==retries+2,"retry: idempotent write is retried");
+	retries=sql.retries();
+	{
+		transaction tr(sql);
+		check(throws(sql,"select * from retried",true) && sql.retries()==retries,"retry: no retries inside transaction");
+	}
+	sql.retry(retry_policy());
+}
+
+static void test_round_trip(session &sql)
+{
+	sql<<"drop table if exists round_trip",exec();
+	sql<<"create table round_trip ( f real, t timestamp )",exec();
+	// Some drivers return the values as text with 15 digits, so these are compared after fetching
+	double values[]={ 0.1, -2.5e-300, 1e300, 123456789.0 };
+	std::tm t=std::tm();
+	t.tm_year=2009-1900;
+	t.tm_mon=0;
+	t.tm_mday=31;
+	t.tm_hour=12;
+	t.tm_min=34;
+	t.tm_sec=56;
+	for(unsigned i=0;i<sizeof(values)/sizeof(values[0]);i++) {
+		sql<<"delete from round_trip",exec();
+		sql<<"insert into round_trip(f,t) values(?,?)",values[i],t,exec();
+		row r;
+		double f=0;
+		std::tm t2=std::tm();
+		sql<<"select f,t from round_trip",r;
+		r>>f>>t2;
+		check(f==values[i],"round trip: double value is preserved");
+		check(	t2.tm_year==t.tm_year && t2.tm_mon==t.tm_mon && t2.tm_mday==t.tm_mday
+			&& t2.tm_hour==t.tm_hour && t2.tm_min==t.tm_min && t2.tm_sec==t.tm_sec,
+			"round trip: date is preserved");
+	}
+	// Values that need all 17 digits are compared by the database
+	sql<<"delete from round_trip",exec();
+	sql<<"insert into round_trip(f) values(?)",1.0/3,exec();
+	row r;
+	int n=0;
+	sql<<"select count(*) from round_trip where f=1.0/3.0",r;
+	r>>n;
+	check(n==1,"round trip: double value is sent with full precision");
+}
+
+static void test_views(session &sql)
+{
+	sql<<"drop table if exists viewed",exec();
+	sql<<"create table viewed ( s text, b blob )",exec();
+	char const data[]={ 'a', 0, 'b' };
+	sql<<"insert into viewed(s,b) values(?,?)","hello",blob(data,sizeof(data)),exec();
+	sql<<"insert into viewed(s,b) values(NULL,NULL)",exec();
+	result res;
+	sql<<"select s,b from viewed order by s is null",res;
+	row r;
+	char const *text=NULL;
+	unsigned char const *bytes=NULL;
+	size_t len=0;
+	check(res.next(r) && r.fetch_view(1,text,len) && std::string(text,len)=="hello","views: text is viewed");
+	check(r.fetch_binary(2,bytes,len) && len==3 && bytes[1]==0 && bytes[2]=='b',"views: binary data is viewed");
+	check(res.next(r) && !r.fetch_view(1,text,len) && !r.fetch_binary(2,bytes,len),"views: null is reported");
+}
+
+static void test_batches(session &sql)
+{
+	sql<<"drop table if exists batched",exec();
+	sql<<"create table batched ( n integer, s text )",exec();
+	for(int i=0;i<5;i++)
+		sql<<"insert into batched(n,s) values(?,?)",i,use("x",i==3),exec();
+	result res;
+	sql<<"select n,s from batched order by n",res;
+	std::vector<int> ns;
+	std::vector<std::string> ss;
+	std::vector<bool> nulls;
+	batch b;
+	b.column(ns).column(ss,&nulls);
+	check(res.fetch_batch(3,b)==3 && ns.size()==3 && ns[2]==2 && ss[0]=="x","batch: first batch is full");
+	check(res.fetch_batch(3,b)==2 && ns.size()==2 && ns[0]==3 && nulls[0] && !nulls[1],"batch: rest with nulls");
+	check(res.fetch_batch(3,b)==0 && ns.empty(),"batch: no more rows");
+}
+
+static void test_outputs(session &sql)
+{
+	sql<<"drop table if exists outputs",exec();
+	sql<<"create table outputs ( n integer, f real, s text )",exec();
+	sql<<"insert into outputs(n,f,s) values(1,2.5,'a')",exec();
+	sql<<"insert into outputs(n,f,s) values(2,NULL,NULL)",exec();
+	result res;
+	sql<<"select n,f,s,n from outputs order by n",res;
+	int n=0;
+	double f=0,as_double=0;
+	std::string s;
+	bool f_null=false,s_null=false;
+	res.into(n).into(f,&f_null).into(s,&s_null).into(as_double);
+	check(res.next() && n==1 && f==2.5 && !f_null && s=="a" && !s_null && as_double==1,
+		"outputs: values are stored to the bound variables");
+	check(res.next() && n==2 && f_null && s_null && as_double==2,"outputs: nulls are reported");
+	check(!res.next(),"outputs: no more rows");
+}
+
+static void test_mapping(session &sql)
+{
+	sql<<"drop table if exists people",exec();
+	sql<<"create table people ( id integer, name text, score real )",exec();
+	person p;
+	p.id=1;
+	p.name="first";
+	p.score=1.5;
+	sql<<"insert into people(id,name,score) values(?,?,?)",fields(p),exec();
+	sql<<"insert into people(id,name,score) values(2,NULL,NULL)",exec();
+	result res;
+	sql<<"select id,name,score from people order by id",res;
+	person q;
+	check(res.next_into(q) && q.id==1 && q.name=="first" && q.score==1.5,"mapping: fields are fetched");
+	check(res.next_into(q) && q.id==2 && q.name.empty() && q.score==0,"mapping: null columns reset the fields");
+	check(!res.next_into(q),"mapping: no more rows");
+	std::vector<person> all;
+	sql<<"select id,name,score from people order by id",res;
+	res.fetch_all(all);
+	check(all.size()==2 && all[0].name=="first" && all[1].id==2,"mapping: all rows are fetched");
+}
+
+static void test_table(session &sql)
+{
+	sql<<"drop table if exists materialized",exec();
+	sql<<"create table materialized ( n integer, f real, s text, d timestamp )",exec();
+	std::tm t=std::tm();
+	t.tm_year=2010-1900;
+	t.tm_mon=5;
+	t.tm_mday=15;
+	sql<<"insert into materialized(n,f,s,d) values(?,?,?,?)",-3,0.25,"text",t,exec();
+	sql<<"insert into materialized(n,f,s,d) values(NULL,NULL,NULL,NULL)",exec();
+	table tab;
+	{
+		result res;
+		sql<<"select n,f,s,d from materialized order by n is null",res;
+		res.materialize(tab);
+	}
+	check(tab.rows()==2 && tab.cols()==4 && tab.name(3)=="s" && tab.index("d")==4,"table: shape and names");
+	std::tm d=tab.get<std::tm>(0,4);
+	check(	tab.get<int>(0,1)==-3 && tab.get<double>(0,2)==0.25 && tab.get<std::string>(0,3)=="text"
+		&& d.tm_year==t.tm_year && d.tm_mon==t.tm_mon && d.tm_mday==t.tm_mday,
+		"table: values are kept after the result is destroyed");
+	char const *view=NULL;
+	size_t len=0;
+	check(tab.fetch_view(0,3,view,len) && std::string(view,len)=="text","table: text view");
+	check(tab.isnull(1,1) && tab.isnull(1,3) && !tab.fetch_view(1,3,view,len),"table: nulls");
+}
+
+static void test_bulk(session &sql)
+{
+	sql<<"drop table if exists bulk",exec();
+	sql<<"create table bulk ( n integer )",exec();
+	bulk_insert ins(sql,"insert into bulk(n) values","(?)",3);
+	for(int i=0;i<10;i++)
+		ins,i;
+	check(ins.pending()==1 && count_rows(sql,"bulk")==9,"bulk: full batches are executed");
+	ins.flush();
+	check(ins.pending()==0 && ins.affected()==10 && count_rows(sql,"bulk")==10,"bulk: flush executes the rest");
+}
+
+static void test_savepoints(session &sql)
+{
+	sql<<"drop table if exists nested",exec();
+	sql<<"create table nested ( n integer )",exec();
+	{
+		transaction outer(sql);
+		sql<<"insert into nested(n) values(1)",exec();
+		{
+			transaction inner(sql);
+			sql<<"insert into nested(n) values(2)",exec();
+		}
+		{
+			transaction inner(sql);
+			sql<<"insert into nested(n) values(3)",exec();
+			inner.commit();
+		}
+		outer.commit();
+	}
+	row r;
+	int sum=0;
+	sql<<"select sum(n) from nested",r;
+	r>>sum;
+	check(count_rows(sql,"nested")==2 && sum==4,"savepoints: only the inner rollback is undone");
+}
+
+static void test_statement(session &sql)
+{
+	sql<<"drop table if exists reused",exec();
+	sql<<"create table reused ( n integer )",exec();
+	statement ins(sql,"insert into reused(n) values(?)");
+	for(int i=0;i<5;i++) {
+		ins.reset();
+		ins,i,exec();
+		check(ins.affected()==1,"statement: each execution inserts a row");
+	}
+	statement sel(sql,"select n from reused where n=?");
+	for(int i=0;i<5;i++) {
+		row r;
+		int n=-1;
+		sel.reset();
+		sel,i;
+		check(sel.single(r) && (r>>n,n==i),"statement: reused select finds the row");
+	}
+	check(count_rows(sql,"reused")==5,"statement: all rows inserted");
+}
+
+static void test_single(session &sql)
+{
+	row r;
+	int a=0;
+	std::string b;
+	double c=0;
+	sql<<"select 1 as a, 'x' as b, 2.5 as c";
+	check(sql.single(r),"single: row is found");
+	check(r.cols()==3,"single: number of columns");
+	r>>a>>b;
+	r.fetch("c",c);
+	check(a==1 && b=="x" && c==2.5,"single: values by position and by name");
+	check(r.index("b")==2 && r.columns().name(3)=="c","single: column names");
+}
+
+static void test_stream(session &sql)
+{
+	sql<<"drop table if exists streamed",exec();
+	sql<<"create table streamed ( n integer )",exec();
+	for(int i=0;i<5;i++)
+		sql<<"insert into streamed(n) values(?)",i,exec();
+	bool thrown=false;
+	try {
+		result res;
+		sql<<"select n from streamed";
+		sql.fetch_stream(res,2);
+	}
+	catch(dbixx_error const &) {
+		thrown=true;
+	}
+	check(thrown,"stream: fetch outside of transaction throws");
+	{
+		transaction tr(sql);
+		result res;
+		sql<<"select n from streamed order by n";
+		sql.fetch_stream(res,2);
+		row r;
+		int sum=0,n=0;
+		while(res.next(r)) {
+			r>>n;
+			sum+=n;
+		}
+		check(sum==10,"stream: all rows are read in batches");
+		tr.commit();
+	}
+	{
+		transaction tr(sql);
+		{
+			result res;
+			sql<<"select n from streamed";
+			sql.fetch_stream(res,2);
+			row r;
+			res.next(r);
+		}
+		sql<<"delete from streamed",exec();
+		tr.commit();
+	}
+	check(count_rows(sql,"streamed")==0,"stream: partially read result is closed");
+}
+
+static void test_cache(session &sql)
+{
+	sql<<"drop table if exists cached",exec();
+	sql<<"drop table if exists other",exec();
+	sql<<"create table cached ( n integer )",exec();
+	sql<<"create table other ( n integer )",exec();
+	sql<<"insert into cached(n) values(1)",exec();
+	query_cache cache;
+	sql.cache(&cache);
+	table t;
+	sql<<"select n from cached",t;
+	sql<<"select n from cached",t;
+	check(cache.hits()==1 && cache.misses()==1 && t.rows()==1,"cache: repeated query is a hit");
+	sql<<"insert into other(n) values(1)",exec();
+	sql<<"select n from cached",t;
+	check(cache.hits()==2,"cache: write to other table keeps the entry");
+	sql<<"insert into cached(n) values(2)",exec();
+	sql<<"select n from cached",t;
+	check(cache.misses()==2 && t.rows()==2,"cache: write to the table invalidates the entry");
+	table copy;
+	sql<<"select n from cached",copy;
+	cache.clear();
+	check(copy.rows()==2 && copy.get<int>(1,1)==2,"cache: copy outlives the entry");
+	sql.cache(NULL);
+}
+
+static std::string export_text(session &sql,data_format f)
+{
+	result res;
+	sql<<"select n,s,d from exported order by n",res;
+	std::ostringstream out;
+	stream_sink s(out);
+	export_result(res,s,f);
+	return out.str();
+}
+
+static void test_export(session &sql)
+{
+	sql<<"drop table if exists exported",exec();
+	sql<<"create table exported ( n integer, s text, d timestamp )",exec();
+	std::tm t=std::tm();
+	t.tm_year=2009-1900;
+	t.tm_mday=31;
+	t.tm_hour=23;
+	sql<<"insert into exported(n,s,d) values(?,?,?)",1,"a,\"b\"",t,exec();
+	sql<<"insert into exported(n,s) values(?,?)",2,"x\ty",exec();
+	sql<<"insert into exported(n,s) values(?,?)",3,"",exec();
+	check(export_text(sql,csv_format)=="n,s,d\n1,\"a,\"\"b\"\"\",2009-01-31 23:00:00\n2,x\ty,\n3,\"\",\n",
+		"export: csv quoting, nulls and empty strings");
+	check(export_text(sql,tsv_format)=="n\ts\td\n1\ta,\"b\"\t2009-01-31 23:00:00\n2\tx\\ty\t\\N\n3\t\t\\N\n",
+		"export: tsv escapes and nulls");
+	check(export_text(sql,binary_format).compare(0,8,"DBIXXB1\n")==0,"export: binary header");
+}
+
+static void test_export_import(session &sql)
+{
+	sql<<"drop table if exists exported",exec();
+	sql<<"drop table if exists imported",exec();
+	sql<<"create table exported ( n integer, f real, s text, d timestamp )",exec();
+	sql<<"create table imported ( n integer, f real, s text, d timestamp )",exec();
+	std::tm t=std::tm();
+	t.tm_year=2009-1900;
+	t.tm_mday=31;
+	t.tm_hour=23;
+	sql<<"insert into exported(n,f,s,d) values(?,?,?,?)",-7,0.5,"a,\"b\"\tc\\d\ne",t,exec();
+	sql<<"insert into exported(n,f,s,d) values(?,?,?,?)",1,1e300,"",t,exec();
+	sql<<"insert into exported(n) values(?)",2,exec();
+	data_format formats[]={ csv_format, tsv_format, binary_format };
+	for(unsigned i=0;i<3;i++) {
+		sql<<"delete from imported",exec();
+		{
+			result res;
+			sql<<"select n,f,s,d from exported order by n",res;
+			std::ofstream out("test_export.dat",std::ios::binary);
+			stream_sink s(out);
+			check(export_result(res,s,formats[i])==3,"export: all rows are written");
+		}
+		import_stats st=import_file(sql,"test_export.dat","imported",formats[i]);
+		check(st.rows==3 && st.rejected==0,"import: all rows are inserted");
+		result a,b;
+		sql<<"select n,f,s,d from exported order by n",a;
+		sql<<"select n,f,s,d from imported order by n",b;
+		row ra,rb;
+		bool same=true;
+		while(a.next(ra)) {
+			if(!b.next(rb)) {
+				same=false;
+				break;
+			}
+			for(int col=1;col<=4;col++)
+				same = same && ra.isnull(col)==rb.isnull(col);
+			if(!same || ra.isnull(2))
+				continue;
+			same=	ra.get<int>(1)==rb.get<int>(1) && ra.get<double>(2)==rb.get<double>(2)
+				&& ra.get<std::string>(3)==rb.get<std::string>(3)
+				&& ra.get<std::tm>(4).tm_hour==rb.get<std::tm>(4).tm_hour;
+		}
+		check(same && !b.next(rb),"export: imported rows are the same as exported");
+	}
+}
+
+static void test_replicas()
+{
+	char const *names[]={ "primary", "replica" };
+	for(unsigned i=0;i<2;i++) {
+		session s(std::string("sqlite3:dbname=test_")+names[i]+".db;sqlite3_dbdir=./");
+		s<<"drop table if exists servers",exec();
+		s<<"create table servers ( id integer primary key autoincrement, name text )",exec();
+		s<<"insert into servers(name) values(?)",names[i],exec();
+	}
+	replica_set replicas;
+	replicas.add("sqlite3:dbname=test_replica.db;sqlite3_dbdir=./");
+	session sql("sqlite3:dbname=test_primary.db;sqlite3_dbdir=./");
+	sql.replicas(&replicas);
+	row r;
+	std::string name;
+	sql<<"select name from servers",r;
+	r>>name;
+	check(name=="replica","replicas: reads go to the replica");
+	{
+		transaction tr(sql);
+		sql<<"select name from servers",r;
+		r>>name;
+		check(name=="primary","replicas: reads inside transaction go to the primary");
+		tr.commit();
+	}
+	sql<<"insert into servers(name) values(?) returning name","written",r;
+	sql.replicas(NULL);
+	check(count_rows(sql,"servers")==2,"replicas: fetched writes go to the primary");
+}
+
 int main()
 {
 	try {
@@ -66,6 +821,37 @@ int main()
 	sql<<"delete from test where 1<>0",
 		exec();
 	cout<<"Deleted "<<sql.affected()<<" rows\n";
+
+	test_pool("sqlite3:dbname=test.db;sqlite3_dbdir=./");
+	test_async(sql,"sqlite3:dbname=test.db;sqlite3_dbdir=./");
+	test_group_commit(sql,"sqlite3:dbname=test.db;sqlite3_dbdir=./");
+	test_threads("sqlite3:dbname=test.db;sqlite3_dbdir=./");
+	test_parallel("sqlite3:dbname=test.db;sqlite3_dbdir=./");
+	test_pipeline(sql,"sqlite3:dbname=test.db;sqlite3_dbdir=./");
+	test_templates(sql);
+	test_server_prepare(sql);
+	test_observer(sql);
+	test_retry(sql);
+	test_round_trip(sql);
+	test_views(sql);
+	test_batches(sql);
+	test_outputs(sql);
+	test_mapping(sql);
+	test_table(sql);
+	test_bulk(sql);
+	test_savepoints(sql);
+	test_statement(sql);
+	test_single(sql);
+	test_stream(sql);
+	test_cache(sql);
+	test_export(sql);
+	test_export_import(sql);
+	test_replicas();
+	if(failures) {
+		cerr<<failures<<" checks failed"<<endl;
+		return 1;
+	}
+	cout<<"All checks passed"<<endl;
 	return 0;
 	}
 	catch(dbixx_error const  &e) {
@@ -74,4 +860,5 @@ int main()
 	catch(exception const  &e) {
 		std::cerr<<"Error:"<<e.what()<<std::endl;
 	}
+	return 1;
 }
@@ -0,0 +1,126 @@
+#include "util.h"
+#include <limits>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <locale.h>
+#include <sys/time.h>
+
+#if defined(_WIN32) || defined(WIN32) || defined(__WIN32) && !defined(__CYGWIN__)
+#define WIN_NATIVE
+#endif
+
+namespace dbixx {
+
+char *format_unsigned(char *p,unsigned long long v)
+{
+	char tmp[std::numeric_limits<unsigned long long>::digits10 + 2];
+	char *end=tmp+sizeof(tmp);
+	char *q=end;
+	do {
+		*--q=char('0' + v % 10);
+		v/=10;
+	} while(v!=0);
+	memcpy(p,q,end-q);
+	return p+(end-q);
+}
+
+char *format_signed(char *p,long long v)
+{
+	if(v < 0) {
+		*p++='-';
+		// Negate in unsigned arithmetic so the minimal value does not overflow
+		return format_unsigned(p,0ULL-static_cast<unsigned long long>(v));
+	}
+	return format_unsigned(p,v);
+}
+
+static char *fix_decimal_point(char *p,int len)
+{
+	// printf family is locale dependent, SQL and the export formats are not
+	char point=localeconv()->decimal_point[0];
+	if(point!='.') {
+		char *d=static_cast<char *>(memchr(p,point,len));
+		if(d)
+			*d='.';
+	}
+	return p+len;
+}
+
+char *format_double(char *p,double v)
+{
+	// Integer values are very common, format them without printf
+	if(-1e15 < v && v < 1e15 && v==static_cast<double>(static_cast<long long>(v)) && (v!=0 || 1/v > 0))
+		return format_signed(p,static_cast<long long>(v));
+	int len=0;
+	for(int prec=std::numeric_limits<double>::digits10;;prec++) {
+		len=snprintf(p,64,"%.*g",prec,v);
+		if(prec >= std::numeric_limits<double>::digits10+2 || strtod(p,NULL)==v || v!=v)
+			break;
+	}
+	return fix_decimal_point(p,len);
+}
+
+char *format_long_double(char *p,long double v)
+{
+	int len=0;
+	for(int prec=std::numeric_limits<long double>::digits10;;prec++) {
+		len=snprintf(p,80,"%.*Lg",prec,v);
+		if(prec >= std::numeric_limits<long double>::digits10+3 || strtold(p,NULL)==v || v!=v)
+			break;
+	}
+	return fix_decimal_point(p,len);
+}
+
+char *format_digits(char *p,int v,int width)
+{
+	for(int i=width-1;i>=0;i--) {
+		p[i]=char('0' + v % 10);
+		v/=10;
+	}
+	return p+width;
+}
+
+char *format_datetime(char *p,std::tm const &t)
+{
+	int year=t.tm_year+1900;
+	int mon=t.tm_mon+1;
+	if(	year < 0 || year > 9999 || mon < 0 || mon > 99
+		|| t.tm_mday < 0 || t.tm_mday > 99 || t.tm_hour < 0 || t.tm_hour > 99
+		|| t.tm_min < 0 || t.tm_min > 99 || t.tm_sec < 0 || t.tm_sec > 99)
+	{
+		// Keep the invalid values visible to the database or the reader
+		return p+snprintf(p,72,"%04d-%02d-%02d %02d:%02d:%02d",
+			year,mon,t.tm_mday,t.tm_hour,t.tm_min,t.tm_sec);
+	}
+	p=format_digits(p,year,4);
+	*p++='-';
+	p=format_digits(p,mon,2);
+	*p++='-';
+	p=format_digits(p,t.tm_mday,2);
+	*p++=' ';
+	p=format_digits(p,t.tm_hour,2);
+	*p++=':';
+	p=format_digits(p,t.tm_min,2);
+	*p++=':';
+	p=format_digits(p,t.tm_sec,2);
+	return p;
+}
+
+void utc_time(time_t v,std::tm &t)
+{
+	#ifdef WIN_NATIVE
+	t=*gmtime(&v);
+	#else
+	gmtime_r(&v,&t);
+	#endif
+}
+
+double now()
+{
+	struct timeval tv;
+	gettimeofday(&tv,NULL);
+	return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+} // dbixx
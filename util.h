@@ -0,0 +1,48 @@
+#ifndef _DBIXX_UTIL_H_
+#define _DBIXX_UTIL_H_
+
+#include <ctime>
+
+//
+// Internal helpers shared by the library sources, this header is not installed
+//
+
+namespace dbixx {
+
+//
+// Fast locale independent formatting, each function writes the text at p without
+// terminating zero and returns the end of the written text.
+//
+
+// At most 20 characters
+char *format_unsigned(char *p,unsigned long long v);
+// At most 21 characters
+char *format_signed(char *p,long long v);
+// Shortest text that reads back as the same value, at most 64 characters
+char *format_double(char *p,double v);
+// Shortest text that reads back as the same value, at most 80 characters
+char *format_long_double(char *p,long double v);
+// Exactly width digits of non-negative v
+char *format_digits(char *p,int v,int width);
+// "YYYY-MM-DD HH:MM:SS", 19 characters if all fields fit their width, otherwise the
+// fields are written in full, at most 71 characters
+char *format_datetime(char *p,std::tm const &t);
+
+//
+// Flag set in the type of unsigned integer columns in the binary export format
+//
+const unsigned char unsigned_type_flag=0x80;
+
+//
+// Convert v to broken down UTC time, thread safe version of gmtime()
+//
+void utc_time(time_t v,std::tm &t);
+
+//
+// Current wall clock time in seconds
+//
+double now();
+
+} // dbixx
+
+#endif // _DBIXX_UTIL_H_